@@ -0,0 +1,416 @@
+#include <benchmark/benchmark.h>
+
+#include <RTree.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dataset.hpp"
+
+/*
+  Benchmarks of RTree operations, parameterised by
+  dimension, MAX_ENTRIES, split algorithm, data distribution and N.
+
+  Benchmark names are
+    operation/dim:D/M:MAX_ENTRIES/split/distribution/N:count
+
+  Extra flag:
+    --max_n=COUNT   largest N to run, in powers of 10 from 1000
+                    (default 100000, up to 10000000)
+
+  Use Google Benchmark's own flags to filter and export, e.g.
+    ./benchmarks --benchmark_filter='window/dim:2/.*' \
+                 --benchmark_out=result.json --benchmark_out_format=json
+*/
+
+namespace er = eh::rtree;
+namespace eb = eh::rtree::bench;
+
+template <er::size_type MaxEntries, typename SplitAlgorithm>
+struct bench_config
+{
+  constexpr static er::size_type MIN_ENTRIES = MaxEntries / 2;
+  constexpr static er::size_type MAX_ENTRIES = MaxEntries;
+  constexpr static er::size_type REINSERT_COUNT
+      = MaxEntries * 3 / 10 > 0 ? MaxEntries * 3 / 10 : 1;
+  using split_algorithm = SplitAlgorithm;
+};
+
+template <int Dim, er::size_type MaxEntries, typename SplitAlgorithm>
+struct bench_tree
+{
+  constexpr static int DIM = Dim;
+  using point_type = er::point_t<double, Dim>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type,
+                               aabb_type,
+                               int,
+                               bench_config<MaxEntries, SplitAlgorithm>>;
+  using static_type = er::static_rtree<aabb_type, aabb_type, int, MaxEntries>;
+
+  static aabb_type to_aabb(eb::box_t<Dim> const& b)
+  {
+    point_type min_point;
+    point_type max_point;
+    min_point.assign(b.min, b.min + Dim);
+    max_point.assign(b.max, b.max + Dim);
+    return { min_point, max_point };
+  }
+};
+
+// generated data are shared between benchmarks of the same dimension
+template <int Dim>
+std::vector<eb::box_t<Dim>> const& dataset(eb::distribution_t d,
+                                           std::size_t count)
+{
+  static std::map<std::pair<eb::distribution_t, std::size_t>,
+                  std::vector<eb::box_t<Dim>>>
+      cache;
+  auto it = cache.find({ d, count });
+  if (it == cache.end())
+  {
+    it = cache.emplace(std::make_pair(d, count), eb::generate<Dim>(d, count, 1))
+             .first;
+  }
+  return it->second;
+}
+
+// 1000 windows of 0.1% world volume
+template <int Dim>
+std::vector<eb::box_t<Dim>> const& windows(eb::distribution_t d,
+                                           std::size_t count)
+{
+  static std::map<std::pair<eb::distribution_t, std::size_t>,
+                  std::vector<eb::box_t<Dim>>>
+      cache;
+  auto it = cache.find({ d, count });
+  if (it == cache.end())
+  {
+    it = cache
+             .emplace(std::make_pair(d, count),
+                      eb::generate_windows<Dim>(dataset<Dim>(d, count), 1000,
+                                                0.001, 2))
+             .first;
+  }
+  return it->second;
+}
+
+template <typename Tree>
+typename Tree::rtree_type build(eb::distribution_t d, std::size_t count)
+{
+  typename Tree::rtree_type rtree;
+  auto const& data = dataset<Tree::DIM>(d, count);
+  for (std::size_t i = 0; i < data.size(); ++i)
+  {
+    rtree.insert({ Tree::to_aabb(data[i]), int(i) });
+  }
+  return rtree;
+}
+
+template <typename Tree>
+void bm_insert(benchmark::State& state, eb::distribution_t d, std::size_t n)
+{
+  auto const& data = dataset<Tree::DIM>(d, n);
+  for (auto _ : state)
+  {
+    typename Tree::rtree_type rtree;
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+      rtree.insert({ Tree::to_aabb(data[i]), int(i) });
+    }
+    benchmark::DoNotOptimize(rtree.root());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Tree>
+void bm_erase(benchmark::State& state, eb::distribution_t d, std::size_t n)
+{
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    typename Tree::rtree_type rtree = build<Tree>(d, n);
+    state.ResumeTiming();
+    while (!rtree.empty())
+    {
+      rtree.erase(rtree.begin());
+    }
+    benchmark::DoNotOptimize(rtree.root());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Tree>
+void bm_window(benchmark::State& state, eb::distribution_t d, std::size_t n)
+{
+  const typename Tree::rtree_type rtree = build<Tree>(d, n);
+  auto const& queries = windows<Tree::DIM>(d, n);
+  std::size_t q = 0;
+  std::size_t hits = 0;
+  for (auto _ : state)
+  {
+    const auto window = Tree::to_aabb(queries[q]);
+    q = (q + 1) % queries.size();
+    rtree.search(
+        [&](typename Tree::aabb_type const& bound)
+        { return er::helper::is_overlap(bound, window) ? 1 : 0; },
+        [&](typename Tree::rtree_type::value_type const& value)
+        {
+          hits += er::helper::is_overlap(value.first, window);
+          return false;
+        });
+  }
+  benchmark::DoNotOptimize(hits);
+  state.counters["hits"]
+      = benchmark::Counter(double(hits), benchmark::Counter::kAvgIterations);
+}
+
+template <typename Tree>
+void bm_nearest(benchmark::State& state, eb::distribution_t d, std::size_t n)
+{
+  const typename Tree::rtree_type rtree = build<Tree>(d, n);
+  auto const& queries = windows<Tree::DIM>(d, n);
+  std::vector<typename Tree::rtree_type::nearest_value_type> result;
+  std::size_t q = 0;
+  for (auto _ : state)
+  {
+    typename Tree::point_type point;
+    for (int i = 0; i < Tree::DIM; ++i)
+    {
+      point[i] = (queries[q].min[i] + queries[q].max[i]) * 0.5;
+    }
+    q = (q + 1) % queries.size();
+    result.clear();
+    rtree.nearest(point, 10, std::back_inserter(result));
+    benchmark::DoNotOptimize(result.data());
+  }
+}
+
+template <typename Tree>
+typename Tree::static_type build_static(eb::distribution_t d,
+                                       std::size_t count)
+{
+  std::vector<typename Tree::static_type::value_type> values;
+  auto const& data = dataset<Tree::DIM>(d, count);
+  for (std::size_t i = 0; i < data.size(); ++i)
+  {
+    values.push_back({ Tree::to_aabb(data[i]), int(i) });
+  }
+  return typename Tree::static_type(std::move(values));
+}
+
+// packed Hilbert tree with NodeSize = MAX_ENTRIES
+template <typename Tree>
+void bm_static_window(benchmark::State& state,
+                      eb::distribution_t d,
+                      std::size_t n)
+{
+  const typename Tree::static_type tree = build_static<Tree>(d, n);
+  auto const& queries = windows<Tree::DIM>(d, n);
+  std::size_t q = 0;
+  std::size_t hits = 0;
+  for (auto _ : state)
+  {
+    const auto window = Tree::to_aabb(queries[q]);
+    q = (q + 1) % queries.size();
+    tree.search(
+        [&](typename Tree::aabb_type const& bound)
+        { return er::helper::is_overlap(bound, window) ? 1 : 0; },
+        [&](typename Tree::static_type::value_type const& value)
+        {
+          hits += er::helper::is_overlap(value.first, window);
+          return false;
+        });
+  }
+  benchmark::DoNotOptimize(hits);
+  state.counters["hits"]
+      = benchmark::Counter(double(hits), benchmark::Counter::kAvgIterations);
+}
+
+template <typename Tree>
+void bm_static_nearest(benchmark::State& state,
+                       eb::distribution_t d,
+                       std::size_t n)
+{
+  const typename Tree::static_type tree = build_static<Tree>(d, n);
+  auto const& queries = windows<Tree::DIM>(d, n);
+  std::vector<typename Tree::static_type::nearest_value_type> result;
+  std::size_t q = 0;
+  for (auto _ : state)
+  {
+    typename Tree::point_type point;
+    for (int i = 0; i < Tree::DIM; ++i)
+    {
+      point[i] = (queries[q].min[i] + queries[q].max[i]) * 0.5;
+    }
+    q = (q + 1) % queries.size();
+    result.clear();
+    tree.nearest(point, 10, std::back_inserter(result));
+    benchmark::DoNotOptimize(result.data());
+  }
+}
+
+template <typename Tree>
+void bm_iterate(benchmark::State& state, eb::distribution_t d, std::size_t n)
+{
+  const typename Tree::rtree_type rtree = build<Tree>(d, n);
+  for (auto _ : state)
+  {
+    long long sum = 0;
+    for (auto const& value : rtree)
+    {
+      sum += value.second;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Tree>
+void bm_flatten(benchmark::State& state, eb::distribution_t d, std::size_t n)
+{
+  const typename Tree::rtree_type rtree = build<Tree>(d, n);
+  for (auto _ : state)
+  {
+    auto flat = rtree.flatten();
+    benchmark::DoNotOptimize(flat.nodes.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Tree>
+void bm_copy(benchmark::State& state, eb::distribution_t d, std::size_t n)
+{
+  const typename Tree::rtree_type rtree = build<Tree>(d, n);
+  for (auto _ : state)
+  {
+    typename Tree::rtree_type copy(rtree);
+    benchmark::DoNotOptimize(copy.root());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Tree>
+void bm_rebalance(benchmark::State& state, eb::distribution_t d, std::size_t n)
+{
+  const typename Tree::rtree_type rtree = build<Tree>(d, n);
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    typename Tree::rtree_type copy(rtree);
+    state.ResumeTiming();
+    copy.rebalance();
+    benchmark::DoNotOptimize(copy.root());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+using function_type
+    = void (*)(benchmark::State&, eb::distribution_t, std::size_t);
+
+// registers `operation/config/distribution/N:count` for every operation,
+// distribution and N
+template <std::size_t Count>
+void register_operations(
+    std::pair<char const*, function_type> const (&operations)[Count],
+    std::string const& config,
+    std::size_t max_n)
+{
+  const eb::distribution_t distributions[] = {
+    eb::distribution_t::uniform, eb::distribution_t::gaussian,
+    eb::distribution_t::clustered, eb::distribution_t::skewed
+  };
+
+  for (auto const& op : operations)
+  {
+    for (eb::distribution_t d : distributions)
+    {
+      for (std::size_t n = 1000; n <= max_n; n *= 10)
+      {
+        const std::string name = std::string(op.first) + "/" + config + "/"
+                                 + eb::distribution_name(d)
+                                 + "/N:" + std::to_string(n);
+        benchmark::RegisterBenchmark(name.c_str(), op.second, d, n)
+            ->Unit(benchmark::kMicrosecond);
+      }
+    }
+  }
+}
+
+template <int Dim, er::size_type MaxEntries, typename SplitAlgorithm>
+void register_tree(char const* split_name, std::size_t max_n)
+{
+  using tree = bench_tree<Dim, MaxEntries, SplitAlgorithm>;
+  const std::pair<char const*, function_type> operations[] = {
+    { "insert", bm_insert<tree> },   { "erase", bm_erase<tree> },
+    { "window", bm_window<tree> },   { "nearest", bm_nearest<tree> },
+    { "iterate", bm_iterate<tree> }, { "flatten", bm_flatten<tree> },
+    { "copy", bm_copy<tree> },       { "rebalance", bm_rebalance<tree> },
+  };
+  register_operations(operations,
+                      "dim:" + std::to_string(Dim) + "/M:"
+                          + std::to_string(MaxEntries) + "/" + split_name,
+                      max_n);
+}
+
+// static_rtree is packed without splits; registered once per (Dim, M)
+template <int Dim, er::size_type MaxEntries>
+void register_static_tree(std::size_t max_n)
+{
+  using tree = bench_tree<Dim, MaxEntries, er::RStarSplit>;
+  const std::pair<char const*, function_type> operations[] = {
+    { "static_window", bm_static_window<tree> },
+    { "static_nearest", bm_static_nearest<tree> },
+  };
+  register_operations(operations,
+                      "dim:" + std::to_string(Dim) + "/M:"
+                          + std::to_string(MaxEntries),
+                      max_n);
+}
+
+int main(int argc, char** argv)
+{
+  benchmark::Initialize(&argc, argv);
+
+  std::size_t max_n = 100000;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strncmp(argv[i], "--max_n=", 8) == 0)
+    {
+      max_n = std::min<std::size_t>(
+          std::strtoull(argv[i] + 8, nullptr, 10), 10000000);
+    }
+    else
+    {
+      std::cerr << "Unknown argument: " << argv[i] << "\n";
+      return 1;
+    }
+  }
+
+  // dimension
+  register_tree<1, 8, er::RStarSplit>("rstar", max_n);
+  register_tree<2, 8, er::RStarSplit>("rstar", max_n);
+  register_tree<3, 8, er::RStarSplit>("rstar", max_n);
+  register_tree<4, 8, er::RStarSplit>("rstar", max_n);
+  // node capacity and split algorithm
+  register_tree<2, 16, er::RStarSplit>("rstar", max_n);
+  register_tree<2, 32, er::RStarSplit>("rstar", max_n);
+  register_tree<2, 8, er::QuadraticSplit>("quadratic", max_n);
+  register_tree<2, 32, er::QuadraticSplit>("quadratic", max_n);
+  // static_rtree for every (dimension, node capacity) above
+  register_static_tree<1, 8>(max_n);
+  register_static_tree<2, 8>(max_n);
+  register_static_tree<3, 8>(max_n);
+  register_static_tree<4, 8>(max_n);
+  register_static_tree<2, 16>(max_n);
+  register_static_tree<2, 32>(max_n);
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace eh
+{
+namespace rtree
+{
+namespace bench
+{
+
+// shape of generated data
+enum class distribution_t
+{
+  // points uniformly distributed in [0, 1000)^Dim
+  uniform,
+  // points with normal distribution on each axis, mu = 0, sigma = 5;
+  // same as example/visualize_*
+  gaussian,
+  // points gathered around 100 uniformly distributed cluster centers
+  clustered,
+  // rectangles with log-uniform extent on each axis, up to 100:1 aspect
+  skewed,
+  // squares with Zipf-distributed side length; few large, many small
+  zipf,
+  // thin line-like boxes of length 50 along a random axis
+  lines,
+};
+
+inline char const* distribution_name(distribution_t d)
+{
+  switch (d)
+  {
+  case distribution_t::uniform:
+    return "uniform";
+  case distribution_t::gaussian:
+    return "gaussian";
+  case distribution_t::clustered:
+    return "clustered";
+  case distribution_t::skewed:
+    return "skewed";
+  case distribution_t::zipf:
+    return "zipf";
+  case distribution_t::lines:
+    return "lines";
+  }
+  return "";
+}
+
+// plain axis-aligned box; min == max for points
+template <int Dim>
+struct box_t
+{
+  double min[Dim];
+  double max[Dim];
+};
+
+// `count` boxes of distribution `d`; same seed gives the same data
+template <int Dim>
+std::vector<box_t<Dim>>
+generate(distribution_t d, std::size_t count, std::uint64_t seed)
+{
+  std::mt19937_64 mt(seed);
+  std::uniform_real_distribution<double> uniform(0, 1000);
+  std::normal_distribution<double> normal(0, 5);
+  std::normal_distribution<double> cluster_spread(0, 10);
+  std::uniform_real_distribution<double> log_extent(std::log(0.1),
+                                                    std::log(10.0));
+
+  std::vector<box_t<Dim>> centers(100);
+  for (box_t<Dim>& c : centers)
+  {
+    for (int i = 0; i < Dim; ++i)
+    {
+      c.min[i] = c.max[i] = uniform(mt);
+    }
+  }
+  std::uniform_int_distribution<std::size_t> pick(0, centers.size() - 1);
+
+  // zipf ranks 1..1000 with exponent 1, sampled by inverse CDF
+  std::vector<double> zipf_cdf(1000);
+  double zipf_sum = 0;
+  for (std::size_t k = 0; k < zipf_cdf.size(); ++k)
+  {
+    zipf_sum += 1.0 / double(k + 1);
+    zipf_cdf[k] = zipf_sum;
+  }
+  std::uniform_real_distribution<double> zipf_u(0, zipf_sum);
+  std::uniform_int_distribution<int> pick_axis(0, Dim - 1);
+
+  std::vector<box_t<Dim>> ret(count);
+  for (box_t<Dim>& b : ret)
+  {
+    box_t<Dim> const& center = centers[pick(mt)];
+    double side = 0;
+    int axis = 0;
+    if (d == distribution_t::zipf)
+    {
+      const std::size_t rank
+          = std::lower_bound(zipf_cdf.begin(), zipf_cdf.end() - 1, zipf_u(mt))
+            - zipf_cdf.begin();
+      side = 100.0 / double(rank + 1);
+    }
+    else if (d == distribution_t::lines)
+    {
+      axis = pick_axis(mt);
+    }
+    for (int i = 0; i < Dim; ++i)
+    {
+      switch (d)
+      {
+      case distribution_t::uniform:
+        b.min[i] = b.max[i] = uniform(mt);
+        break;
+      case distribution_t::gaussian:
+        b.min[i] = b.max[i] = normal(mt);
+        break;
+      case distribution_t::clustered:
+        b.min[i] = b.max[i] = center.min[i] + cluster_spread(mt);
+        break;
+      case distribution_t::skewed:
+        b.min[i] = uniform(mt);
+        b.max[i] = b.min[i] + std::exp(log_extent(mt));
+        break;
+      case distribution_t::zipf:
+        b.min[i] = uniform(mt);
+        b.max[i] = b.min[i] + side;
+        break;
+      case distribution_t::lines:
+        b.min[i] = uniform(mt);
+        b.max[i] = b.min[i] + (i == axis ? 50.0 : 0.01);
+        break;
+      }
+    }
+  }
+  return ret;
+}
+
+// bounding box of every box in `boxes`
+template <int Dim>
+box_t<Dim> world_bound(std::vector<box_t<Dim>> const& boxes)
+{
+  box_t<Dim> ret = boxes.front();
+  for (box_t<Dim> const& b : boxes)
+  {
+    for (int i = 0; i < Dim; ++i)
+    {
+      ret.min[i] = std::min(ret.min[i], b.min[i]);
+      ret.max[i] = std::max(ret.max[i], b.max[i]);
+    }
+  }
+  return ret;
+}
+
+// `count` query windows centered at random boxes of `data`,
+// each covering `selectivity` of the world volume
+template <int Dim>
+std::vector<box_t<Dim>> generate_windows(std::vector<box_t<Dim>> const& data,
+                                         std::size_t count,
+                                         double selectivity,
+                                         std::uint64_t seed)
+{
+  std::mt19937_64 mt(seed);
+  std::uniform_int_distribution<std::size_t> pick(0, data.size() - 1);
+  const box_t<Dim> world = world_bound(data);
+  const double side = std::pow(selectivity, 1.0 / Dim);
+
+  std::vector<box_t<Dim>> ret(count);
+  for (box_t<Dim>& w : ret)
+  {
+    box_t<Dim> const& b = data[pick(mt)];
+    for (int i = 0; i < Dim; ++i)
+    {
+      const double center = (b.min[i] + b.max[i]) * 0.5;
+      const double half = (world.max[i] - world.min[i]) * side * 0.5;
+      w.min[i] = center - half;
+      w.max[i] = center + half;
+    }
+  }
+  return ret;
+}
+
+}
+}
+} // namespace eh rtree bench
@@ -0,0 +1,255 @@
+#include <RTree.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "workload.hpp"
+
+/*
+  Config auto-tuner.
+
+  tune <log> [out.hpp]
+
+  Replays the operation log ( see workload.hpp ) against a grid of Configs:
+    MAX_ENTRIES     4, 8, 16, 32, 64
+    MIN_ENTRIES     20%, 40%, 50% of MAX_ENTRIES
+    REINSERT_COUNT  1, 30% of MAX_ENTRIES
+    split_algorithm RStarSplit, QuadraticSplit
+  and measures mean insert latency, mean query latency and memory of the
+  final tree. Prints the Pareto-optimal Configs on these three costs, and
+  writes the one with the lowest query latency as `TunedConfig` to out.hpp.
+*/
+
+namespace er = eh::rtree;
+namespace eb = eh::rtree::bench;
+
+template <er::size_type MinEntries,
+          er::size_type MaxEntries,
+          er::size_type ReinsertCount,
+          typename SplitAlgorithm>
+struct grid_config
+{
+  constexpr static er::size_type MIN_ENTRIES = MinEntries;
+  constexpr static er::size_type MAX_ENTRIES = MaxEntries;
+  constexpr static er::size_type REINSERT_COUNT = ReinsertCount;
+  using split_algorithm = SplitAlgorithm;
+};
+
+struct candidate_t
+{
+  er::size_type min_entries;
+  er::size_type max_entries;
+  er::size_type reinsert_count;
+  std::string split;
+
+  // mean latency in nanoseconds
+  double insert_cost;
+  double query_cost;
+  // bytes of nodes of the final tree
+  std::size_t memory;
+
+  bool dominates(candidate_t const& rhs) const
+  {
+    return insert_cost <= rhs.insert_cost && query_cost <= rhs.query_cost
+           && memory <= rhs.memory
+           && (insert_cost < rhs.insert_cost || query_cost < rhs.query_cost
+               || memory < rhs.memory);
+  }
+
+  std::string config_struct(std::string const& name) const
+  {
+    return "struct " + name + "\n{\n"
+           + "  constexpr static eh::rtree::size_type MIN_ENTRIES = "
+           + std::to_string(min_entries) + ";\n"
+           + "  constexpr static eh::rtree::size_type MAX_ENTRIES = "
+           + std::to_string(max_entries) + ";\n"
+           + "  constexpr static eh::rtree::size_type REINSERT_COUNT = "
+           + std::to_string(reinsert_count) + ";\n"
+           + "  using split_algorithm = eh::rtree::" + split + ";\n};\n";
+  }
+};
+
+template <int Dim, typename Config>
+candidate_t evaluate(std::vector<eb::operation_t<Dim>> const& ops,
+                     char const* split)
+{
+  using point_type = er::point_t<double, Dim>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, aabb_type, std::uint64_t, Config>;
+
+  rtree_type rtree;
+  const eb::replay_result_t result = eb::replay(
+      rtree, ops,
+      [](eb::box_t<Dim> const& b)
+      {
+        point_type min_point;
+        point_type max_point;
+        min_point.assign(b.min, b.min + Dim);
+        max_point.assign(b.max, b.max + Dim);
+        return aabb_type(min_point, max_point);
+      });
+
+  std::size_t memory = 0;
+  for (int level = 0; level < rtree.leaf_level(); ++level)
+  {
+    memory += std::distance(rtree.node_begin(level), rtree.node_end(level))
+              * sizeof(typename rtree_type::node_type);
+  }
+  memory += std::distance(rtree.leaf_begin(), rtree.leaf_end())
+            * sizeof(typename rtree_type::leaf_type);
+
+  return { Config::MIN_ENTRIES,
+           Config::MAX_ENTRIES,
+           Config::REINSERT_COUNT,
+           split,
+           result.latency[int(eb::operation_type_t::insert)].mean,
+           result.latency[int(eb::operation_type_t::query)].mean,
+           memory };
+}
+
+// every MIN_ENTRIES and REINSERT_COUNT for given MAX_ENTRIES and split
+template <int Dim, er::size_type MaxEntries, typename SplitAlgorithm>
+void evaluate_capacity(std::vector<eb::operation_t<Dim>> const& ops,
+                       char const* split,
+                       std::vector<candidate_t>& candidates)
+{
+  constexpr er::size_type MIN_LOW = std::max<er::size_type>(MaxEntries / 5, 1);
+  constexpr er::size_type MIN_MID
+      = std::max<er::size_type>(MaxEntries * 2 / 5, 1);
+  constexpr er::size_type MIN_HIGH = MaxEntries / 2;
+  constexpr er::size_type REINSERT
+      = std::max<er::size_type>(MaxEntries * 3 / 10, 1);
+  using min_low = grid_config<MIN_LOW, MaxEntries, 1, SplitAlgorithm>;
+  using min_mid = grid_config<MIN_MID, MaxEntries, 1, SplitAlgorithm>;
+  using min_high = grid_config<MIN_HIGH, MaxEntries, 1, SplitAlgorithm>;
+  using min_low_r = grid_config<MIN_LOW, MaxEntries, REINSERT, SplitAlgorithm>;
+  using min_mid_r = grid_config<MIN_MID, MaxEntries, REINSERT, SplitAlgorithm>;
+  using min_high_r
+      = grid_config<MIN_HIGH, MaxEntries, REINSERT, SplitAlgorithm>;
+
+  // skip duplicated grid points of small MAX_ENTRIES
+  candidates.push_back(evaluate<Dim, min_low>(ops, split));
+  if constexpr (MIN_MID != MIN_LOW)
+  {
+    candidates.push_back(evaluate<Dim, min_mid>(ops, split));
+  }
+  if constexpr (MIN_HIGH != MIN_MID)
+  {
+    candidates.push_back(evaluate<Dim, min_high>(ops, split));
+  }
+  if constexpr (REINSERT > 1)
+  {
+    candidates.push_back(evaluate<Dim, min_low_r>(ops, split));
+    if constexpr (MIN_MID != MIN_LOW)
+    {
+      candidates.push_back(evaluate<Dim, min_mid_r>(ops, split));
+    }
+    if constexpr (MIN_HIGH != MIN_MID)
+    {
+      candidates.push_back(evaluate<Dim, min_high_r>(ops, split));
+    }
+  }
+  std::cerr << "evaluated MAX_ENTRIES=" << MaxEntries << " " << split << "\n";
+}
+
+template <int Dim>
+bool tune(std::string const& path, std::string const& out)
+{
+  std::vector<eb::operation_t<Dim>> ops;
+  if (!eb::read_operations<Dim>(path, ops))
+  {
+    std::cerr << "failed to read operation log: " << path << "\n";
+    return false;
+  }
+
+  std::vector<candidate_t> candidates;
+  evaluate_capacity<Dim, 4, er::RStarSplit>(ops, "RStarSplit", candidates);
+  evaluate_capacity<Dim, 8, er::RStarSplit>(ops, "RStarSplit", candidates);
+  evaluate_capacity<Dim, 16, er::RStarSplit>(ops, "RStarSplit", candidates);
+  evaluate_capacity<Dim, 32, er::RStarSplit>(ops, "RStarSplit", candidates);
+  evaluate_capacity<Dim, 64, er::RStarSplit>(ops, "RStarSplit", candidates);
+  evaluate_capacity<Dim, 4, er::QuadraticSplit>(ops, "QuadraticSplit",
+                                                candidates);
+  evaluate_capacity<Dim, 8, er::QuadraticSplit>(ops, "QuadraticSplit",
+                                                candidates);
+  evaluate_capacity<Dim, 16, er::QuadraticSplit>(ops, "QuadraticSplit",
+                                                 candidates);
+  evaluate_capacity<Dim, 32, er::QuadraticSplit>(ops, "QuadraticSplit",
+                                                 candidates);
+  evaluate_capacity<Dim, 64, er::QuadraticSplit>(ops, "QuadraticSplit",
+                                                 candidates);
+
+  std::vector<candidate_t> pareto;
+  for (candidate_t const& c : candidates)
+  {
+    if (std::none_of(candidates.begin(), candidates.end(),
+                     [&](candidate_t const& other)
+                     { return other.dominates(c); }))
+    {
+      pareto.push_back(c);
+    }
+  }
+  std::sort(pareto.begin(), pareto.end(),
+            [](candidate_t const& a, candidate_t const& b)
+            { return a.query_cost < b.query_cost; });
+
+  std::cout << "Pareto-optimal Configs ( " << pareto.size() << " of "
+            << candidates.size() << " )\n";
+  std::cout << "MIN\tMAX\tREINSERT\tsplit\t\tinsert(ns)\tquery(ns)\tmemory\n";
+  for (candidate_t const& c : pareto)
+  {
+    std::cout << c.min_entries << "\t" << c.max_entries << "\t"
+              << c.reinsert_count << "\t\t" << c.split << "\t"
+              << c.insert_cost << "\t\t" << c.query_cost << "\t\t" << c.memory
+              << "\n";
+  }
+  std::cout << "\n" << pareto.front().config_struct("TunedConfig");
+
+  if (!out.empty())
+  {
+    std::ofstream os(out);
+    os << "#pragma once\n\n#include <RTree.hpp>\n\n"
+       << "// tuned for " << path << "; lowest query latency on the Pareto "
+       << "front\n"
+       << pareto.front().config_struct("TunedConfig");
+    if (!os)
+    {
+      std::cerr << "failed to write " << out << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2 || argc > 3)
+  {
+    std::cerr << "Invalid Arguments:\n" << argv[0] << " <log> [out.hpp]\n";
+    return 1;
+  }
+  const std::string path = argv[1];
+  const std::string out = argc > 2 ? argv[2] : "";
+  bool ok = false;
+  switch (eb::file_dimension(path))
+  {
+  case 1:
+    ok = tune<1>(path, out);
+    break;
+  case 2:
+    ok = tune<2>(path, out);
+    break;
+  case 3:
+    ok = tune<3>(path, out);
+    break;
+  case 4:
+    ok = tune<4>(path, out);
+    break;
+  default:
+    std::cerr << "failed to read operation log: " << path << "\n";
+  }
+  return ok ? 0 : 1;
+}
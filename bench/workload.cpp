@@ -0,0 +1,232 @@
+#include <RTree.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "workload.hpp"
+
+/*
+  Workload generator and replayer.
+
+  workload dataset <distribution> <dim> <count> <seed> <out>
+      write `count` boxes of the distribution to a dataset file
+  workload mixed <distribution> <dim> <count> <seed> <out>
+      write an operation log; `count` inserts followed by `count`
+      mixed insert / erase / query operations
+  workload trajectory <dim> <objects> <steps> <seed> <out>
+      write an operation log of moving points
+  workload replay <log> [max_entries] [split]
+      replay an operation log and report throughput and latency;
+      max_entries is one of 8, 16, 32 (default 8),
+      split is either rstar (default) or quadratic
+
+  distribution: uniform, gaussian, clustered, skewed, zipf, lines
+  dim: 1 to 4
+*/
+
+namespace er = eh::rtree;
+namespace eb = eh::rtree::bench;
+
+template <er::size_type MaxEntries, typename SplitAlgorithm>
+struct replay_config
+{
+  constexpr static er::size_type MIN_ENTRIES = MaxEntries / 2;
+  constexpr static er::size_type MAX_ENTRIES = MaxEntries;
+  constexpr static er::size_type REINSERT_COUNT
+      = MaxEntries * 3 / 10 > 0 ? MaxEntries * 3 / 10 : 1;
+  using split_algorithm = SplitAlgorithm;
+};
+
+bool parse_distribution(char const* name, eb::distribution_t& d)
+{
+  const eb::distribution_t all[]
+      = { eb::distribution_t::uniform, eb::distribution_t::gaussian,
+          eb::distribution_t::clustered, eb::distribution_t::skewed,
+          eb::distribution_t::zipf, eb::distribution_t::lines };
+  for (eb::distribution_t candidate : all)
+  {
+    if (std::strcmp(name, eb::distribution_name(candidate)) == 0)
+    {
+      d = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+// calls `functor(std::integral_constant<int, dim>())` for dim in [1, 4]
+template <typename Functor>
+bool dispatch_dimension(unsigned long dim, Functor&& functor)
+{
+  switch (dim)
+  {
+  case 1:
+    return functor(std::integral_constant<int, 1>());
+  case 2:
+    return functor(std::integral_constant<int, 2>());
+  case 3:
+    return functor(std::integral_constant<int, 3>());
+  case 4:
+    return functor(std::integral_constant<int, 4>());
+  }
+  std::cerr << "dimension must be in [1, 4]\n";
+  return false;
+}
+
+template <int Dim, er::size_type MaxEntries, typename SplitAlgorithm>
+bool replay_log(std::vector<eb::operation_t<Dim>> const& ops)
+{
+  using point_type = er::point_t<double, Dim>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type
+      = er::RTree<aabb_type, aabb_type, std::uint64_t,
+                  replay_config<MaxEntries, SplitAlgorithm>>;
+
+  rtree_type rtree;
+  const eb::replay_result_t result = eb::replay(
+      rtree, ops,
+      [](eb::box_t<Dim> const& b)
+      {
+        point_type min_point;
+        point_type max_point;
+        min_point.assign(b.min, b.min + Dim);
+        max_point.assign(b.max, b.max + Dim);
+        return aabb_type(min_point, max_point);
+      });
+
+  std::cout << "operations: " << ops.size() << "\n";
+  std::cout << "seconds: " << result.seconds << "\n";
+  std::cout << "throughput (ops/s): " << result.throughput << "\n";
+  std::cout << "missing erases: " << result.missing_erases << "\n";
+  std::cout << "query hits: " << result.query_hits << "\n";
+  char const* names[3] = { "insert", "erase", "query" };
+  std::cout << "latency (ns)\tcount\tp50\tp90\tp99\tp99.9\tmax\n";
+  for (int t = 0; t < 3; ++t)
+  {
+    eb::latency_t const& l = result.latency[t];
+    std::cout << names[t] << "\t\t" << l.count << "\t" << l.p50 << "\t"
+              << l.p90 << "\t" << l.p99 << "\t" << l.p999 << "\t" << l.max
+              << "\n";
+  }
+  return true;
+}
+
+template <int Dim>
+bool replay_file(std::string const& path,
+                 unsigned long max_entries,
+                 std::string const& split)
+{
+  std::vector<eb::operation_t<Dim>> ops;
+  if (!eb::read_operations<Dim>(path, ops))
+  {
+    std::cerr << "failed to read operation log: " << path << "\n";
+    return false;
+  }
+  const bool rstar = split == "rstar";
+  if (!rstar && split != "quadratic")
+  {
+    std::cerr << "unknown split algorithm: " << split << "\n";
+    return false;
+  }
+  switch (max_entries)
+  {
+  case 8:
+    return rstar ? replay_log<Dim, 8, er::RStarSplit>(ops)
+                 : replay_log<Dim, 8, er::QuadraticSplit>(ops);
+  case 16:
+    return rstar ? replay_log<Dim, 16, er::RStarSplit>(ops)
+                 : replay_log<Dim, 16, er::QuadraticSplit>(ops);
+  case 32:
+    return rstar ? replay_log<Dim, 32, er::RStarSplit>(ops)
+                 : replay_log<Dim, 32, er::QuadraticSplit>(ops);
+  }
+  std::cerr << "max_entries must be one of 8, 16, 32\n";
+  return false;
+}
+
+int usage(char const* program)
+{
+  std::cerr << "Invalid Arguments:\n"
+            << program << " dataset <distribution> <dim> <count> <seed> <out>\n"
+            << program << " mixed <distribution> <dim> <count> <seed> <out>\n"
+            << program << " trajectory <dim> <objects> <steps> <seed> <out>\n"
+            << program << " replay <log> [max_entries] [split]\n";
+  return 1;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    return usage(argv[0]);
+  }
+  const std::string command = argv[1];
+  bool ok = false;
+  if (command == "dataset" || command == "mixed")
+  {
+    eb::distribution_t d;
+    if (argc != 7 || !parse_distribution(argv[2], d))
+    {
+      return usage(argv[0]);
+    }
+    const std::size_t count = std::strtoull(argv[4], nullptr, 10);
+    const std::uint64_t seed = std::strtoull(argv[5], nullptr, 10);
+    const std::string out = argv[6];
+    ok = dispatch_dimension(
+        std::strtoul(argv[3], nullptr, 10),
+        [&](auto dim)
+        {
+          constexpr int DIM = decltype(dim)::value;
+          if (command == "dataset")
+          {
+            return eb::write_dataset<DIM>(out,
+                                          eb::generate<DIM>(d, count, seed));
+          }
+          return eb::write_operations<DIM>(
+              out, eb::generate_mixed<DIM>(d, count, seed));
+        });
+  }
+  else if (command == "trajectory")
+  {
+    if (argc != 7)
+    {
+      return usage(argv[0]);
+    }
+    const std::size_t objects = std::strtoull(argv[3], nullptr, 10);
+    const std::size_t steps = std::strtoull(argv[4], nullptr, 10);
+    const std::uint64_t seed = std::strtoull(argv[5], nullptr, 10);
+    const std::string out = argv[6];
+    if (objects == 0)
+    {
+      return usage(argv[0]);
+    }
+    ok = dispatch_dimension(
+        std::strtoul(argv[2], nullptr, 10),
+        [&](auto dim)
+        {
+          constexpr int DIM = decltype(dim)::value;
+          return eb::write_operations<DIM>(
+              out, eb::generate_trajectories<DIM>(objects, steps, seed));
+        });
+  }
+  else if (command == "replay")
+  {
+    const std::string path = argv[2];
+    const unsigned long max_entries
+        = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 8;
+    const std::string split = argc > 4 ? argv[4] : "rstar";
+    ok = dispatch_dimension(eb::file_dimension(path),
+                            [&](auto dim)
+                            {
+                              constexpr int DIM = decltype(dim)::value;
+                              return replay_file<DIM>(path, max_entries,
+                                                      split);
+                            });
+  }
+  else
+  {
+    return usage(argv[0]);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dataset.hpp"
+
+/*
+  Reproducible workloads; datasets and operation logs,
+  their binary file formats, and replay against any RTree.
+
+  Every integer and floating point value is stored in native byte order;
+  files written on a machine of the other byte order are rejected by the
+  endian tag.
+
+  dataset file:
+    char[4]   "RTDS"
+    uint32    version (2)
+    uint32    endian tag (0x01020304)
+    uint32    dimension
+    uint64    count
+    count * { double min[dimension], double max[dimension] }
+
+  operation log file:
+    char[4]   "RTOP"
+    uint32    version (2)
+    uint32    endian tag (0x01020304)
+    uint32    dimension
+    uint64    count
+    count * {
+      uint8   type (0: insert, 1: erase, 2: query)
+      uint64  timestamp in nanoseconds
+      uint64  id; mapped value of inserted/erased value, unused for query
+      double  min[dimension], max[dimension]; key, or query window
+    }
+*/
+
+namespace eh
+{
+namespace rtree
+{
+namespace bench
+{
+
+enum class operation_type_t : std::uint8_t
+{
+  insert = 0,
+  // erase the value with `id`, whose key is `box`
+  erase = 1,
+  // window query on `box`
+  query = 2,
+};
+
+template <int Dim>
+struct operation_t
+{
+  operation_type_t type;
+  std::uint64_t timestamp;
+  std::uint64_t id;
+  box_t<Dim> box;
+};
+
+namespace detail
+{
+constexpr std::uint32_t FILE_VERSION = 2;
+constexpr std::uint32_t FILE_ENDIAN = 0x01020304;
+// bytes of one record of operation log file
+template <int Dim>
+constexpr std::uint64_t OPERATION_SIZE
+    = 1 + 2 * sizeof(std::uint64_t) + sizeof(box_t<Dim>);
+
+template <typename T>
+void write_raw(std::ostream& os, T const& value)
+{
+  os.write(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+template <typename T>
+bool read_raw(std::istream& is, T& value)
+{
+  return bool(is.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+inline void write_header(std::ostream& os,
+                         char const* magic,
+                         std::uint32_t dim,
+                         std::uint64_t count)
+{
+  os.write(magic, 4);
+  write_raw(os, FILE_VERSION);
+  write_raw(os, FILE_ENDIAN);
+  write_raw(os, dim);
+  write_raw(os, count);
+}
+// bytes from the current position to the end of `is`
+inline std::uint64_t remaining_bytes(std::istream& is)
+{
+  const std::streampos pos = is.tellg();
+  is.seekg(0, std::ios::end);
+  const std::streampos end = is.tellg();
+  is.seekg(pos);
+  return pos < 0 || end < pos ? 0 : std::uint64_t(end - pos);
+}
+
+// returns false on wrong magic, version, byte order or dimension,
+// or if the file is too short for `count` records of `record_size` bytes
+inline bool read_header(std::istream& is,
+                        char const* magic,
+                        std::uint32_t dim,
+                        std::uint64_t record_size,
+                        std::uint64_t& count)
+{
+  char m[4];
+  std::uint32_t version;
+  std::uint32_t endian;
+  std::uint32_t d;
+  return is.read(m, 4) && std::memcmp(m, magic, 4) == 0
+         && read_raw(is, version) && version == FILE_VERSION
+         && read_raw(is, endian) && endian == FILE_ENDIAN && read_raw(is, d)
+         && d == dim && read_raw(is, count)
+         && count <= remaining_bytes(is) / record_size;
+}
+}
+
+// dimension stored in a dataset or operation log file; 0 on failure
+inline std::uint32_t file_dimension(std::string const& path)
+{
+  std::ifstream is(path, std::ios::binary);
+  char m[4];
+  std::uint32_t version;
+  std::uint32_t endian;
+  std::uint32_t dim;
+  if (is.read(m, 4) && detail::read_raw(is, version)
+      && version == detail::FILE_VERSION && detail::read_raw(is, endian)
+      && endian == detail::FILE_ENDIAN && detail::read_raw(is, dim))
+  {
+    return dim;
+  }
+  return 0;
+}
+
+template <int Dim>
+bool write_dataset(std::string const& path,
+                   std::vector<box_t<Dim>> const& boxes)
+{
+  std::ofstream os(path, std::ios::binary);
+  detail::write_header(os, "RTDS", Dim, boxes.size());
+  for (box_t<Dim> const& b : boxes)
+  {
+    detail::write_raw(os, b);
+  }
+  return bool(os);
+}
+
+template <int Dim>
+bool read_dataset(std::string const& path, std::vector<box_t<Dim>>& boxes)
+{
+  std::ifstream is(path, std::ios::binary);
+  std::uint64_t count;
+  if (!detail::read_header(is, "RTDS", Dim, sizeof(box_t<Dim>), count))
+  {
+    return false;
+  }
+  boxes.resize(count);
+  for (box_t<Dim>& b : boxes)
+  {
+    if (!detail::read_raw(is, b))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <int Dim>
+bool write_operations(std::string const& path,
+                      std::vector<operation_t<Dim>> const& ops)
+{
+  std::ofstream os(path, std::ios::binary);
+  detail::write_header(os, "RTOP", Dim, ops.size());
+  for (operation_t<Dim> const& op : ops)
+  {
+    detail::write_raw(os, std::uint8_t(op.type));
+    detail::write_raw(os, op.timestamp);
+    detail::write_raw(os, op.id);
+    detail::write_raw(os, op.box);
+  }
+  return bool(os);
+}
+
+template <int Dim>
+bool read_operations(std::string const& path,
+                     std::vector<operation_t<Dim>>& ops)
+{
+  std::ifstream is(path, std::ios::binary);
+  std::uint64_t count;
+  if (!detail::read_header(is, "RTOP", Dim, detail::OPERATION_SIZE<Dim>,
+                           count))
+  {
+    return false;
+  }
+  ops.resize(count);
+  for (operation_t<Dim>& op : ops)
+  {
+    std::uint8_t type;
+    if (!detail::read_raw(is, type) || type > 2
+        || !detail::read_raw(is, op.timestamp) || !detail::read_raw(is, op.id)
+        || !detail::read_raw(is, op.box))
+    {
+      return false;
+    }
+    op.type = operation_type_t(type);
+  }
+  return true;
+}
+
+// inserts every box of `d`, then `count` mixed operations;
+// 50% window queries, 25% inserts and 25% erases of random live values.
+// one operation per microsecond
+template <int Dim>
+std::vector<operation_t<Dim>>
+generate_mixed(distribution_t d, std::size_t count, std::uint64_t seed)
+{
+  const std::vector<box_t<Dim>> data = generate<Dim>(d, count * 2, seed);
+  const std::vector<box_t<Dim>> windows
+      = generate_windows<Dim>(data, count, 0.001, seed + 1);
+  std::mt19937_64 mt(seed + 2);
+  std::uniform_int_distribution<int> pick_op(0, 3);
+
+  std::vector<operation_t<Dim>> ops;
+  std::vector<std::uint64_t> live;
+  std::size_t next = 0;
+  std::uint64_t time = 0;
+  auto insert = [&]()
+  {
+    ops.push_back({ operation_type_t::insert, time, next, data[next] });
+    live.push_back(next++);
+  };
+  for (std::size_t i = 0; i < count; ++i, time += 1000)
+  {
+    insert();
+  }
+  for (std::size_t i = 0; i < count; ++i, time += 1000)
+  {
+    const int op = pick_op(mt);
+    if (op == 0 && next < data.size())
+    {
+      insert();
+    }
+    else if (op == 1 && !live.empty())
+    {
+      std::uniform_int_distribution<std::size_t> pick(0, live.size() - 1);
+      const std::size_t l = pick(mt);
+      const std::uint64_t id = live[l];
+      ops.push_back({ operation_type_t::erase, time, id, data[id] });
+      live[l] = live.back();
+      live.pop_back();
+    }
+    else
+    {
+      ops.push_back({ operation_type_t::query, time, 0, windows[i] });
+    }
+  }
+  return ops;
+}
+
+// `objects` points moving in [0, 1000)^Dim for `steps` time steps
+// with constant random velocity, bouncing at the border.
+// each move is an erase followed by insert of the same id;
+// every step also runs `objects / 10` window queries.
+// one time step is 1 second
+template <int Dim>
+std::vector<operation_t<Dim>>
+generate_trajectories(std::size_t objects,
+                      std::size_t steps,
+                      std::uint64_t seed)
+{
+  std::vector<box_t<Dim>> position
+      = generate<Dim>(distribution_t::uniform, objects, seed);
+  const std::vector<box_t<Dim>> windows
+      = generate_windows<Dim>(position, objects, 0.001, seed + 1);
+  std::mt19937_64 mt(seed + 2);
+  std::normal_distribution<double> speed(0, 1);
+
+  std::vector<box_t<Dim>> velocity(objects);
+  for (box_t<Dim>& v : velocity)
+  {
+    for (int i = 0; i < Dim; ++i)
+    {
+      v.min[i] = v.max[i] = speed(mt);
+    }
+  }
+
+  std::vector<operation_t<Dim>> ops;
+  for (std::size_t o = 0; o < objects; ++o)
+  {
+    ops.push_back({ operation_type_t::insert, 0, o, position[o] });
+  }
+  std::size_t w = 0;
+  for (std::size_t s = 1; s <= steps; ++s)
+  {
+    const std::uint64_t base = std::uint64_t(s) * 1000000000;
+    const std::uint64_t tick = 1000000000 / (objects + objects / 10 + 1);
+    std::uint64_t time = base;
+    for (std::size_t o = 0; o < objects; ++o, time += tick)
+    {
+      ops.push_back({ operation_type_t::erase, time, o, position[o] });
+      for (int i = 0; i < Dim; ++i)
+      {
+        double x = position[o].min[i] + velocity[o].min[i];
+        if (x < 0 || x >= 1000)
+        {
+          velocity[o].min[i] = -velocity[o].min[i];
+          x = std::min(std::max(x, 0.0), 999.0);
+        }
+        position[o].min[i] = position[o].max[i] = x;
+      }
+      ops.push_back({ operation_type_t::insert, time, o, position[o] });
+    }
+    for (std::size_t q = 0; q < objects / 10; ++q, time += tick)
+    {
+      ops.push_back(
+          { operation_type_t::query, time, 0, windows[w++ % windows.size()] });
+    }
+  }
+  return ops;
+}
+
+// latency percentiles of one operation type, in nanoseconds
+struct latency_t
+{
+  std::size_t count = 0;
+  double mean = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+  double p999 = 0;
+  double max = 0;
+};
+
+struct replay_result_t
+{
+  // total wall time of replay, in seconds
+  double seconds = 0;
+  // operations per second
+  double throughput = 0;
+  // indexed by operation_type_t
+  latency_t latency[3];
+  // erases whose id was not found under the given key
+  std::size_t missing_erases = 0;
+  // values found by every query
+  std::size_t query_hits = 0;
+};
+
+inline latency_t summarize_latency(std::vector<double>& nanoseconds)
+{
+  latency_t ret;
+  ret.count = nanoseconds.size();
+  if (nanoseconds.empty())
+  {
+    return ret;
+  }
+  std::sort(nanoseconds.begin(), nanoseconds.end());
+  for (double ns : nanoseconds)
+  {
+    ret.mean += ns;
+  }
+  ret.mean /= double(nanoseconds.size());
+  auto at = [&](double q)
+  { return nanoseconds[std::size_t(q * double(nanoseconds.size() - 1))]; };
+  ret.p50 = at(0.5);
+  ret.p90 = at(0.9);
+  ret.p99 = at(0.99);
+  ret.p999 = at(0.999);
+  ret.max = nanoseconds.back();
+  return ret;
+}
+
+// replays `ops` against `rtree` as fast as possible, in log order.
+// `to_key(box)` converts a box into `key_type` of the tree;
+// ids are stored as `mapped_type`.
+// recorded timestamps are kept in the log for reference only
+template <typename RTreeType, int Dim, typename KeyConverter>
+replay_result_t replay(RTreeType& rtree,
+                       std::vector<operation_t<Dim>> const& ops,
+                       KeyConverter&& to_key)
+{
+  using clock = std::chrono::steady_clock;
+  using mapped_type = typename RTreeType::mapped_type;
+
+  replay_result_t result;
+  std::vector<double> latency[3];
+  const clock::time_point start = clock::now();
+  for (operation_t<Dim> const& op : ops)
+  {
+    const auto key = to_key(op.box);
+    const clock::time_point op_start = clock::now();
+    switch (op.type)
+    {
+    case operation_type_t::insert:
+      rtree.insert({ key, mapped_type(op.id) });
+      break;
+    case operation_type_t::erase:
+    {
+      typename RTreeType::iterator found;
+      bool exists = false;
+      rtree.search_iterator(
+          [&](typename RTreeType::geometry_type const& bound)
+          { return helper::is_overlap(bound, key) ? 1 : 0; },
+          [&](typename RTreeType::iterator it)
+          {
+            if (it->second == mapped_type(op.id))
+            {
+              found = it;
+              exists = true;
+            }
+            return exists;
+          });
+      if (exists)
+      {
+        rtree.erase(found);
+      }
+      else
+      {
+        ++result.missing_erases;
+      }
+      break;
+    }
+    case operation_type_t::query:
+      rtree.search(
+          [&](typename RTreeType::geometry_type const& bound)
+          { return helper::is_overlap(bound, key) ? 1 : 0; },
+          [&](typename RTreeType::value_type const& value)
+          {
+            result.query_hits += helper::is_overlap(value.first, key);
+            return false;
+          });
+      break;
+    }
+    latency[int(op.type)].push_back(
+        std::chrono::duration<double, std::nano>(clock::now() - op_start)
+            .count());
+  }
+  result.seconds
+      = std::chrono::duration<double>(clock::now() - start).count();
+  result.throughput = result.seconds > 0 ? ops.size() / result.seconds : 0;
+  for (int t = 0; t < 3; ++t)
+  {
+    result.latency[t] = summarize_latency(latency[t]);
+  }
+  return result;
+}
+
+}
+}
+} // namespace eh rtree bench
@@ -1,8 +1,19 @@
 #pragma once
 
 #include "RTree/aabb.hpp"
+#include "RTree/bulk_load.hpp"
+#include "RTree/flat_file.hpp"
+#include "RTree/flat_view.hpp"
 #include "RTree/geometry_traits.hpp"
+#include "RTree/hilbert.hpp"
+#include "RTree/hilbert_insert.hpp"
 #include "RTree/iterator.hpp"
+#include "RTree/join.hpp"
+#include "RTree/metric.hpp"
 #include "RTree/quadratic_split.hpp"
+#include "RTree/quality.hpp"
 #include "RTree/rstar_split.hpp"
-#include "RTree/rtree.hpp"
\ No newline at end of file
+#include "RTree/rtree.hpp"
+#include "RTree/serialize.hpp"
+#include "RTree/static_rtree.hpp"
+#include "RTree/stats.hpp"
\ No newline at end of file
@@ -21,16 +21,11 @@ protected:
   scalar_type _data[Dim];
 
 public:
-  point_t()
+  EH_RTREE_HOST_DEVICE point_t()
   {
   }
-  point_t(point_t const& rhs)
-  {
-    for (size_type i = 0; i < size(); ++i)
-    {
-      _data[i] = rhs._data[i];
-    }
-  }
+  // trivially copyable; can be memcpy'd or mapped from files
+  point_t(point_t const& rhs) = default;
   template <typename T0, typename... Ts>
   point_t(T0 arg0, Ts... args)
   {
@@ -57,23 +52,16 @@ public:
       _data[i++] = *begin++;
     }
   }
-  point_t& operator=(point_t const& rhs)
-  {
-    for (size_type i = 0; i < size(); ++i)
-    {
-      _data[i] = rhs._data[i];
-    }
-    return *this;
-  }
-  constexpr static size_type size()
+  point_t& operator=(point_t const& rhs) = default;
+  EH_RTREE_HOST_DEVICE constexpr static size_type size()
   {
     return Dim;
   }
-  scalar_type& operator[](size_type i)
+  EH_RTREE_HOST_DEVICE scalar_type& operator[](size_type i)
   {
     return _data[i];
   }
-  scalar_type operator[](size_type i) const
+  EH_RTREE_HOST_DEVICE scalar_type operator[](size_type i) const
   {
     return _data[i];
   }
@@ -176,11 +164,11 @@ struct geometry_traits<aabb_t<ArithmeticType>>
   // dimension
   constexpr static int DIM = 1;
 
-  static auto min_point(AABB const& bound, int axis)
+  EH_RTREE_HOST_DEVICE static auto min_point(AABB const& bound, int axis)
   {
     return bound.min_;
   }
-  static auto max_point(AABB const& bound, int axis)
+  EH_RTREE_HOST_DEVICE static auto max_point(AABB const& bound, int axis)
   {
     return bound.max_;
   }
@@ -281,11 +269,11 @@ struct geometry_traits<aabb_t<point_t<T, Dim>>>
   // dimension
   constexpr static int DIM = Dim;
 
-  static auto min_point(AABB const& bound, int axis)
+  EH_RTREE_HOST_DEVICE static auto min_point(AABB const& bound, int axis)
   {
     return bound.min_[axis];
   }
-  static auto max_point(AABB const& bound, int axis)
+  EH_RTREE_HOST_DEVICE static auto max_point(AABB const& bound, int axis)
   {
     return bound.max_[axis];
   }
@@ -305,11 +293,13 @@ struct geometry_traits<point_t<T, Dim>>
   using scalar_type = T;
   constexpr static int DIM = Dim;
 
-  static auto min_point(point_t<T, Dim> const& bound, int axis)
+  EH_RTREE_HOST_DEVICE static auto
+  min_point(point_t<T, Dim> const& bound, int axis)
   {
     return bound[axis];
   }
-  static auto max_point(point_t<T, Dim> const& bound, int axis)
+  EH_RTREE_HOST_DEVICE static auto
+  max_point(point_t<T, Dim> const& bound, int axis)
   {
     return bound[axis];
   }
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "geometry_traits.hpp"
+#include "global.hpp"
+#include "hilbert.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+/*
+  Bulk loading strategies for `RTree::bulk_load()`.
+  The tree is built bottom-up, one level at a time; every strategy must
+  implement
+
+  // partitions `bounds` into groups of at most `max_entries`.
+  // appends indices of `bounds` to `order`, group by group,
+  // and the size of each group to `groups`
+  template <typename GeometryType>
+  static void partition(std::vector<GeometryType> const& bounds,
+                        size_type max_entries,
+                        std::vector<size_type>& order,
+                        std::vector<size_type>& groups);
+
+  Consecutive groups are stored next to each other in the tree.
+  Groups smaller than MIN_ENTRIES are merged with their neighbour by
+  `RTree::bulk_load()`.
+*/
+
+// sorts bounds by the Hilbert index of their centers and packs them into
+// full nodes
+struct HilbertBulkLoad
+{
+  template <typename GeometryType>
+  static void partition(std::vector<GeometryType> const& bounds,
+                        size_type max_entries,
+                        std::vector<size_type>& order,
+                        std::vector<size_type>& groups)
+  {
+    if (bounds.empty())
+    {
+      return;
+    }
+    GeometryType world = bounds[0];
+    for (GeometryType const& b : bounds)
+    {
+      helper::enlarge_to(world, b);
+    }
+    const hilbert_mapper_t<GeometryType> mapper(world);
+    std::vector<std::pair<std::uint64_t, size_type>> curve;
+    curve.reserve(bounds.size());
+    for (size_type i = 0; i < bounds.size(); ++i)
+    {
+      curve.emplace_back(mapper(bounds[i]), i);
+    }
+    std::sort(curve.begin(), curve.end());
+    for (size_type i = 0; i < curve.size(); ++i)
+    {
+      order.push_back(curve[i].second);
+      if (i % max_entries == 0)
+      {
+        groups.push_back(std::min(max_entries, size_type(curve.size() - i)));
+      }
+    }
+  }
+};
+
+// packs bounds into full nodes in the given order;
+// for input already sorted by the caller
+struct SequentialBulkLoad
+{
+  template <typename GeometryType>
+  static void partition(std::vector<GeometryType> const& bounds,
+                        size_type max_entries,
+                        std::vector<size_type>& order,
+                        std::vector<size_type>& groups)
+  {
+    for (size_type i = 0; i < bounds.size(); ++i)
+    {
+      order.push_back(i);
+      if (i % max_entries == 0)
+      {
+        groups.push_back(std::min(max_entries, size_type(bounds.size() - i)));
+      }
+    }
+  }
+};
+
+/*
+  Priority R-Tree.
+  Each level is a pseudo-PR-tree over bounds as 2*DIM dimensional points
+  ( min corner, max corner ): every node takes the `max_entries` bounds
+  with the smallest min, then the largest max, on each axis as priority
+  leaves, and splits the rest at the median of one of the 2*DIM
+  coordinates, in turn, until at most `max_entries` are left.
+
+  Window queries visit O((N/B)^(1-1/d) + T/B) leaves, even for bounds of
+  extreme aspect ratio.
+
+  L. Arge, M. de Berg, H. J. Haverkort and K. Yi (2004).
+  "The Priority R-Tree: A Practically Efficient and Worst-Case Optimal
+  R-Tree". SIGMOD 2004, p. 347-358.
+*/
+struct PRTreeBulkLoad
+{
+protected:
+  // coordinate on `axis` of 2*DIM dimensional point of `g`
+  template <typename GeometryType>
+  static auto coordinate(GeometryType const& g, int axis)
+  {
+    constexpr int DIM = geometry_traits<GeometryType>::DIM;
+    return axis < DIM ? helper::min_point(g, axis)
+                      : helper::max_point(g, axis - DIM);
+  }
+
+  template <typename GeometryType, typename Iterator>
+  static void partition_recursive(std::vector<GeometryType> const& bounds,
+                                  size_type max_entries,
+                                  Iterator first,
+                                  Iterator last,
+                                  int depth,
+                                  std::vector<size_type>& order,
+                                  std::vector<size_type>& groups)
+  {
+    constexpr int AXES = geometry_traits<GeometryType>::DIM * 2;
+    auto emit = [&](Iterator end)
+    {
+      order.insert(order.end(), first, end);
+      groups.push_back(size_type(end - first));
+      first = end;
+    };
+
+    if (size_type(last - first) <= max_entries)
+    {
+      if (first != last)
+      {
+        emit(last);
+      }
+      return;
+    }
+
+    // priority leaves; most extreme bounds toward each of 2*DIM directions
+    for (int axis = 0; axis < AXES; ++axis)
+    {
+      if (size_type(last - first) <= max_entries)
+      {
+        if (first != last)
+        {
+          emit(last);
+        }
+        return;
+      }
+      const Iterator end = first + max_entries;
+      std::nth_element(first, end, last,
+                       [&](size_type a, size_type b)
+                       {
+                         return axis < AXES / 2
+                                    ? coordinate(bounds[a], axis)
+                                          < coordinate(bounds[b], axis)
+                                    : coordinate(bounds[a], axis)
+                                          > coordinate(bounds[b], axis);
+                       });
+      emit(end);
+    }
+
+    // kd-tree split of the rest, near the median;
+    // lower half is rounded up to full nodes to keep the leaves full
+    const int axis = depth % AXES;
+    const size_type count = size_type(last - first);
+    size_type half = (count / 2 + max_entries - 1) / max_entries * max_entries;
+    if (half >= count)
+    {
+      half = count / 2;
+    }
+    const Iterator mid = first + half;
+    std::nth_element(first, mid, last,
+                     [&](size_type a, size_type b)
+                     {
+                       return coordinate(bounds[a], axis)
+                              < coordinate(bounds[b], axis);
+                     });
+    partition_recursive(bounds, max_entries, first, mid, depth + 1, order,
+                        groups);
+    partition_recursive(bounds, max_entries, mid, last, depth + 1, order,
+                        groups);
+  }
+
+public:
+  template <typename GeometryType>
+  static void partition(std::vector<GeometryType> const& bounds,
+                        size_type max_entries,
+                        std::vector<size_type>& order,
+                        std::vector<size_type>& groups)
+  {
+    std::vector<size_type> items(bounds.size());
+    std::iota(items.begin(), items.end(), size_type(0));
+    partition_recursive(bounds, max_entries, items.begin(), items.end(), 0,
+                        order, groups);
+  }
+};
+
+}
+} // namespace eh rtree
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+  #define EH_RTREE_HAS_MMAP 1
+#endif
+
+#include "flat_view.hpp"
+#include "geometry_traits.hpp"
+#include "global.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+/*
+  Binary file of flattened tree; loaded by mmap without deserialisation.
+
+  offset 0:   flat_file_header_t
+  every section starts at a multiple of FLAT_FILE_ALIGN bytes:
+    flat_node_t    nodes[node_count]
+    geometry_type  children_bound[slot_count]
+    size_type      children[slot_count]
+    mapped_type    data[data_count]
+
+  Values are stored in native byte order and layout; `endian` and the sizes
+  in the header reject files written on a different platform or with
+  different types. geometry_type and mapped_type must be trivially copyable.
+
+  The header is checked against the file size, but the node table and
+  children indices are not; a crafted file can make queries read out of
+  bounds, so only map files from trusted sources.
+*/
+
+constexpr std::uint32_t FLAT_FILE_VERSION = 1;
+constexpr std::uint32_t FLAT_FILE_ENDIAN = 0x01020304;
+constexpr std::uint64_t FLAT_FILE_ALIGN = 64;
+
+struct flat_file_header_t
+{
+  char magic[8];
+  std::uint32_t version;
+  /// FLAT_FILE_ENDIAN in writer's byte order
+  std::uint32_t endian;
+
+  std::uint32_t dimension;
+  std::uint32_t leaf_level;
+  std::uint32_t root;
+  std::uint32_t layout;
+  std::uint32_t size_type_size;
+  std::uint32_t node_size;
+  std::uint32_t geometry_size;
+  std::uint32_t mapped_size;
+
+  std::uint64_t node_count;
+  std::uint64_t slot_count;
+  std::uint64_t data_count;
+
+  /// byte offsets of sections from the beginning of the file
+  std::uint64_t nodes_offset;
+  std::uint64_t bound_offset;
+  std::uint64_t children_offset;
+  std::uint64_t data_offset;
+  std::uint64_t file_size;
+};
+
+namespace helper
+{
+inline std::uint64_t flat_file_align(std::uint64_t offset)
+{
+  return (offset + FLAT_FILE_ALIGN - 1) / FLAT_FILE_ALIGN * FLAT_FILE_ALIGN;
+}
+
+template <typename GeometryType, typename MappedType>
+flat_file_header_t flat_file_header(std::uint32_t leaf_level,
+                                    std::uint32_t root,
+                                    flatten_layout_t layout,
+                                    std::uint64_t node_count,
+                                    std::uint64_t slot_count,
+                                    std::uint64_t data_count)
+{
+  flat_file_header_t h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, "EHRTFLAT", 8);
+  h.version = FLAT_FILE_VERSION;
+  h.endian = FLAT_FILE_ENDIAN;
+  h.dimension = geometry_traits<GeometryType>::DIM;
+  h.leaf_level = leaf_level;
+  h.root = root;
+  h.layout = std::uint32_t(layout);
+  h.size_type_size = sizeof(size_type);
+  h.node_size = sizeof(flat_node_t);
+  h.geometry_size = sizeof(GeometryType);
+  h.mapped_size = sizeof(MappedType);
+  h.node_count = node_count;
+  h.slot_count = slot_count;
+  h.data_count = data_count;
+  h.nodes_offset = flat_file_align(sizeof(flat_file_header_t));
+  h.bound_offset
+      = flat_file_align(h.nodes_offset + node_count * sizeof(flat_node_t));
+  h.children_offset
+      = flat_file_align(h.bound_offset + slot_count * sizeof(GeometryType));
+  h.data_offset
+      = flat_file_align(h.children_offset + slot_count * sizeof(size_type));
+  h.file_size = h.data_offset + data_count * sizeof(MappedType);
+  return h;
+}
+}
+
+/// writes `flat` ( `RTree::flatten_result_t` ) to `path`.
+/// returns false on I/O failure
+template <typename FlattenResult>
+bool write_flat_file(std::string const& path, FlattenResult const& flat)
+{
+  using geometry_type = typename decltype(flat.children_bound)::value_type;
+  using mapped_type = typename decltype(flat.data)::value_type;
+  static_assert(std::is_trivially_copyable<geometry_type>::value,
+                "geometry_type must be trivially copyable");
+  static_assert(std::is_trivially_copyable<mapped_type>::value,
+                "mapped_type must be trivially copyable");
+
+  const flat_file_header_t h
+      = helper::flat_file_header<geometry_type, mapped_type>(
+          flat.leaf_level, flat.root, flat.layout, flat.nodes.size(),
+          flat.children.size(), flat.data.size());
+
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  std::uint64_t position = 0;
+  auto write_section = [&](std::uint64_t offset, void const* p,
+                           std::uint64_t bytes)
+  {
+    static const char zeros[FLAT_FILE_ALIGN] = {};
+    os.write(zeros, offset - position);
+    os.write(static_cast<char const*>(p), bytes);
+    position = offset + bytes;
+  };
+  write_section(0, &h, sizeof(h));
+  write_section(h.nodes_offset, flat.nodes.data(),
+                flat.nodes.size() * sizeof(flat_node_t));
+  write_section(h.bound_offset, flat.children_bound.data(),
+                flat.children_bound.size() * sizeof(geometry_type));
+  write_section(h.children_offset, flat.children.data(),
+                flat.children.size() * sizeof(size_type));
+  write_section(h.data_offset, flat.data.data(),
+                flat.data.size() * sizeof(mapped_type));
+  return bool(os);
+}
+
+/*
+  Read-only flattened tree mapped from a file written by `write_flat_file()`.
+  Pages are shared between every process mapping the same file.
+  Without mmap ( non-POSIX platforms ), the file is read into memory.
+*/
+template <typename GeometryType, typename MappedType, int MaxHeight = 32>
+class flat_file_t
+{
+public:
+  using geometry_type = GeometryType;
+  using mapped_type = MappedType;
+  using view_type = flat_rtree_view<GeometryType, MappedType, MaxHeight>;
+
+  static_assert(std::is_trivially_copyable<geometry_type>::value,
+                "geometry_type must be trivially copyable");
+  static_assert(std::is_trivially_copyable<mapped_type>::value,
+                "mapped_type must be trivially copyable");
+
+protected:
+  void const* _address = nullptr;
+  std::uint64_t _size = 0;
+  std::vector<std::uint64_t> _buffer;
+  view_type _view;
+  flatten_layout_t _layout = flatten_layout_t::preorder;
+
+  // checks the header against this type and the file size.
+  // every count must fit in the file on its own, so the section offsets
+  // below cannot overflow, and in size_type
+  bool validate(flat_file_header_t const& h) const
+  {
+    constexpr std::uint64_t max_count = std::numeric_limits<size_type>::max();
+    if (h.node_count > _size / sizeof(flat_node_t)
+        || h.slot_count > _size / sizeof(geometry_type)
+        || h.slot_count > _size / sizeof(size_type)
+        || h.data_count > _size / sizeof(mapped_type)
+        || h.node_count > max_count || h.slot_count > max_count
+        || h.data_count > max_count)
+    {
+      return false;
+    }
+    const flat_file_header_t expected
+        = helper::flat_file_header<geometry_type, mapped_type>(
+            h.leaf_level, h.root, flatten_layout_t(h.layout), h.node_count,
+            h.slot_count, h.data_count);
+    return std::memcmp(&h, &expected, sizeof(h)) == 0
+           && h.file_size <= _size && h.node_count > 0
+           && h.root < h.node_count
+           && h.layout <= std::uint32_t(flatten_layout_t::unordered);
+  }
+
+public:
+  flat_file_t()
+  {
+  }
+  flat_file_t(flat_file_t const&) = delete;
+  flat_file_t& operator=(flat_file_t const&) = delete;
+  ~flat_file_t()
+  {
+    close();
+  }
+
+  /// maps `path`; returns false if the file cannot be read or
+  /// was written with different types, version or byte order
+  bool open(std::string const& path)
+  {
+    close();
+#ifdef EH_RTREE_HAS_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < off_t(sizeof(flat_file_header_t)))
+    {
+      ::close(fd);
+      return false;
+    }
+    void* address
+        = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+    {
+      return false;
+    }
+    _address = address;
+    _size = st.st_size;
+#else
+    std::ifstream is(path, std::ios::binary | std::ios::ate);
+    if (!is)
+    {
+      return false;
+    }
+    _size = std::uint64_t(is.tellg());
+    _buffer.resize((_size + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+    is.seekg(0);
+    if (_size < sizeof(flat_file_header_t)
+        || !is.read(reinterpret_cast<char*>(_buffer.data()), _size))
+    {
+      close();
+      return false;
+    }
+    _address = _buffer.data();
+#endif
+
+    flat_file_header_t h;
+    std::memcpy(&h, _address, sizeof(h));
+    if (!validate(h))
+    {
+      close();
+      return false;
+    }
+    char const* base = static_cast<char const*>(_address);
+    _layout = flatten_layout_t(h.layout);
+    _view = view_type(
+        h.leaf_level, h.root,
+        reinterpret_cast<flat_node_t const*>(base + h.nodes_offset),
+        size_type(h.node_count),
+        reinterpret_cast<geometry_type const*>(base + h.bound_offset),
+        reinterpret_cast<size_type const*>(base + h.children_offset),
+        reinterpret_cast<mapped_type const*>(base + h.data_offset),
+        size_type(h.data_count));
+    return true;
+  }
+
+  /// unmaps the file; views taken before become invalid
+  void close()
+  {
+#ifdef EH_RTREE_HAS_MMAP
+    if (_address)
+    {
+      ::munmap(const_cast<void*>(_address), _size);
+    }
+#endif
+    _address = nullptr;
+    _size = 0;
+    _buffer.clear();
+    _view = view_type();
+  }
+
+  bool is_open() const
+  {
+    return _address != nullptr;
+  }
+  flatten_layout_t layout() const
+  {
+    return _layout;
+  }
+  /// query engine over the mapped buffers
+  view_type const& view() const
+  {
+    return _view;
+  }
+};
+
+}
+} // namespace eh, rtree
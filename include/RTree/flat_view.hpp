@@ -0,0 +1,445 @@
+#pragma once
+
+#include <cstddef>
+
+#include "geometry_traits.hpp"
+#include "global.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+/// node of flattened tree; see `RTree::flatten()`
+struct flat_node_t
+{
+  /// offset in global dense buffer
+  size_type offset;
+
+  /// the number of children
+  size_type size;
+
+  /// parent node index
+  size_type parent;
+};
+
+/// order of nodes in the flattened buffers.
+/// the root is always at index 0
+enum class flatten_layout_t
+{
+  /// depth-first preorder; every subtree is contiguous
+  preorder,
+  /// level by level; the top levels pack into the first cache lines
+  breadth_first,
+  /// cache-oblivious van Emde Boas order; recursively the top half of the
+  /// levels, then each bottom subtree
+  van_emde_boas,
+  /// normal nodes in preorder, then every leaf from left to right;
+  /// for streaming scans over leaves
+  leaves_last,
+  /// patched by `RTree::flatten_update()`; nodes, slots and values were
+  /// appended or moved, so no order is guaranteed beyond the root at `root`
+  unordered,
+};
+
+/// buffers of `RTree::flatten_result_t`
+enum class flatten_buffer_t
+{
+  nodes,
+  children_bound,
+  children,
+  data,
+};
+
+/// byte range modified by `RTree::flatten_update()`
+struct flatten_range_t
+{
+  flatten_buffer_t buffer;
+  /// in bytes from the beginning of the buffer
+  std::size_t offset;
+  std::size_t bytes;
+};
+
+/*
+  Read-only query engine directly over the buffers of `RTree::flatten()`.
+
+  The view only holds raw pointers and sizes of the buffers, so it can be
+  copied into a kernel and the same code runs on CPU and on device ( CUDA,
+  HIP ) when the buffers live in device memory. Traversal uses a fixed-size
+  explicit stack of node indices, one entry per level; no recursion, no heap
+  allocation. `MaxHeight` must be greater than `leaf_level`; queries on a
+  deeper tree return false without visiting any node.
+
+  Every callback receives `data_index`, the index on the `data` buffer.
+*/
+template <typename GeometryType, typename MappedType, int MaxHeight = 32>
+class flat_rtree_view
+{
+public:
+  using geometry_type = GeometryType;
+  using mapped_type = MappedType;
+  using traits = geometry_traits<GeometryType>;
+  using scalar_type = typename traits::scalar_type;
+  constexpr static int DIM = traits::DIM;
+  constexpr static int MAX_HEIGHT = MaxHeight;
+
+protected:
+  flat_node_t const* _nodes = nullptr;
+  geometry_type const* _children_bound = nullptr;
+  size_type const* _children = nullptr;
+  mapped_type const* _data = nullptr;
+  size_type _node_count = 0;
+  size_type _data_count = 0;
+  size_type _leaf_level = 0;
+  size_type _root = 0;
+
+public:
+  EH_RTREE_HOST_DEVICE flat_rtree_view()
+  {
+  }
+  EH_RTREE_HOST_DEVICE flat_rtree_view(size_type leaf_level,
+                                       size_type root,
+                                       flat_node_t const* nodes,
+                                       size_type node_count,
+                                       geometry_type const* children_bound,
+                                       size_type const* children,
+                                       mapped_type const* data,
+                                       size_type data_count)
+      : _nodes(nodes)
+      , _children_bound(children_bound)
+      , _children(children)
+      , _data(data)
+      , _node_count(node_count)
+      , _data_count(data_count)
+      , _leaf_level(leaf_level)
+      , _root(root)
+  {
+  }
+  /// view on host memory of `RTree::flatten_result_t`
+  template <typename FlattenResult>
+  explicit flat_rtree_view(FlattenResult const& flat)
+      : flat_rtree_view(flat.leaf_level,
+                        flat.root,
+                        flat.nodes.data(),
+                        flat.nodes.size(),
+                        flat.children_bound.data(),
+                        flat.children.data(),
+                        flat.data.data(),
+                        flat.data.size())
+  {
+    EH_RTREE_ASSERT(flat.leaf_level < size_type(MaxHeight),
+                    "tree is deeper than MaxHeight of flat_rtree_view");
+  }
+
+  EH_RTREE_HOST_DEVICE size_type leaf_level() const
+  {
+    return _leaf_level;
+  }
+  EH_RTREE_HOST_DEVICE size_type root() const
+  {
+    return _root;
+  }
+  EH_RTREE_HOST_DEVICE size_type node_count() const
+  {
+    return _node_count;
+  }
+  EH_RTREE_HOST_DEVICE size_type data_count() const
+  {
+    return _data_count;
+  }
+  EH_RTREE_HOST_DEVICE flat_node_t const& node(size_type index) const
+  {
+    return _nodes[index];
+  }
+  /// bounding box of `slot` on global dense buffer
+  EH_RTREE_HOST_DEVICE geometry_type const& bound(size_type slot) const
+  {
+    return _children_bound[slot];
+  }
+  EH_RTREE_HOST_DEVICE mapped_type const& data(size_type data_index) const
+  {
+    return _data[data_index];
+  }
+
+protected:
+  // depth-first traversal from root.
+  // `node_filter(slot)` decides on children of normal nodes;
+  // 1 to descend, 0 to skip, -1 to stop.
+  // `entry_functor(slot)` is called on children of leaf nodes;
+  // returns true to stop.
+  // returns false if stopped or the tree is too deep
+  template <typename NodeFilter, typename EntryFunctor>
+  EH_RTREE_HOST_DEVICE bool traverse(NodeFilter&& node_filter,
+                                     EntryFunctor&& entry_functor) const
+  {
+    if (_node_count == 0)
+    {
+      return true;
+    }
+    if (_leaf_level >= size_type(MaxHeight))
+    {
+      return false;
+    }
+    size_type stack_node[MaxHeight];
+    size_type stack_cursor[MaxHeight];
+    int top = 0;
+    stack_node[0] = _root;
+    stack_cursor[0] = 0;
+    while (top >= 0)
+    {
+      flat_node_t const& n = _nodes[stack_node[top]];
+      if (stack_cursor[top] == n.size)
+      {
+        --top;
+        continue;
+      }
+      const size_type slot = n.offset + stack_cursor[top]++;
+      if (size_type(top) == _leaf_level)
+      {
+        if (entry_functor(slot))
+        {
+          return false;
+        }
+        continue;
+      }
+      const int decision = node_filter(slot);
+      if (decision < 0)
+      {
+        return false;
+      }
+      if (decision > 0)
+      {
+        ++top;
+        stack_node[top] = _children[slot];
+        stack_cursor[top] = 0;
+      }
+    }
+    return true;
+  }
+
+  template <typename QueryType>
+  EH_RTREE_HOST_DEVICE static bool is_overlap(geometry_type const& bound,
+                                              QueryType const& query)
+  {
+    using query_traits = geometry_traits<QueryType>;
+    for (int i = 0; i < DIM; ++i)
+    {
+      if (traits::max_point(bound, i) < query_traits::min_point(query, i)
+          || query_traits::max_point(query, i) < traits::min_point(bound, i))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // squared euclidean distance from `point` to `bound`; MINDIST
+  template <typename PointType>
+  EH_RTREE_HOST_DEVICE static scalar_type
+  min_distance(geometry_type const& bound, PointType const& point)
+  {
+    using point_traits = geometry_traits<PointType>;
+    scalar_type ret = 0;
+    for (int i = 0; i < DIM; ++i)
+    {
+      const scalar_type p = point_traits::min_point(point, i);
+      scalar_type gap = 0;
+      if (p < traits::min_point(bound, i))
+      {
+        gap = traits::min_point(bound, i) - p;
+      }
+      else if (traits::max_point(bound, i) < p)
+      {
+        gap = p - traits::max_point(bound, i);
+      }
+      ret += gap * gap;
+    }
+    return ret;
+  }
+
+  // slab test; entering parameter of the ray into `bound` in `t`
+  template <typename PointType>
+  EH_RTREE_HOST_DEVICE static bool ray_hit(geometry_type const& bound,
+                                           PointType const& origin,
+                                           PointType const& direction,
+                                           scalar_type t_max,
+                                           scalar_type& t)
+  {
+    using point_traits = geometry_traits<PointType>;
+    scalar_type t_near = 0;
+    scalar_type t_far = t_max;
+    for (int i = 0; i < DIM; ++i)
+    {
+      const scalar_type o = point_traits::min_point(origin, i);
+      const scalar_type d = point_traits::min_point(direction, i);
+      const scalar_type lo = traits::min_point(bound, i);
+      const scalar_type hi = traits::max_point(bound, i);
+      if (d == 0)
+      {
+        if (o < lo || hi < o)
+        {
+          return false;
+        }
+        continue;
+      }
+      scalar_type t0 = (lo - o) / d;
+      scalar_type t1 = (hi - o) / d;
+      if (t1 < t0)
+      {
+        const scalar_type tmp = t0;
+        t0 = t1;
+        t1 = tmp;
+      }
+      t_near = t0 > t_near ? t0 : t_near;
+      t_far = t1 < t_far ? t1 : t_far;
+      if (t_far < t_near)
+      {
+        return false;
+      }
+    }
+    t = t_near;
+    return true;
+  }
+
+public:
+  /// search with the same filters as `RTree::search()`;
+  /// `geometry_filter(bound)` on bounding boxes of normal nodes' children,
+  /// 1 to descend, 0 to skip, -1 to stop.
+  /// `data_functor(bound, data_index)` on every value of reached leaves,
+  /// returns true to stop.
+  /// returns true if the search was completed
+  template <typename GeometryFilter, typename DataFunctor>
+  EH_RTREE_HOST_DEVICE bool search(GeometryFilter&& geometry_filter,
+                                   DataFunctor&& data_functor) const
+  {
+    return traverse(
+        [&](size_type slot) { return geometry_filter(_children_bound[slot]); },
+        [&](size_type slot)
+        { return data_functor(_children_bound[slot], _children[slot]); });
+  }
+
+  /// `functor(bound, data_index)` on every value overlapping `window`,
+  /// boundaries inclusive;
+  /// returns true to stop.
+  /// returns true if the search was completed
+  template <typename QueryType, typename Functor>
+  EH_RTREE_HOST_DEVICE bool search_overlap(QueryType const& window,
+                                           Functor&& functor) const
+  {
+    return traverse(
+        [&](size_type slot)
+        { return is_overlap(_children_bound[slot], window) ? 1 : 0; },
+        [&](size_type slot)
+        {
+          return is_overlap(_children_bound[slot], window)
+                 && functor(_children_bound[slot], _children[slot]);
+        });
+  }
+
+  /// k nearest values from `point` in squared euclidean distance.
+  /// writes at most `k` data indices and distances in increasing order of
+  /// distance to `data_indices` and `distances`, both of size `k`,
+  /// and returns the number of results.
+  /// branch and bound; prunes subtrees farther than the current k-th value
+  template <typename PointType>
+  EH_RTREE_HOST_DEVICE size_type nearest(PointType const& point,
+                                         size_type k,
+                                         size_type* data_indices,
+                                         scalar_type* distances) const
+  {
+    size_type count = 0;
+    if (k == 0)
+    {
+      return 0;
+    }
+    traverse(
+        [&](size_type slot)
+        {
+          return count < k
+                         || min_distance(_children_bound[slot], point)
+                                < distances[k - 1]
+                     ? 1
+                     : 0;
+        },
+        [&](size_type slot)
+        {
+          const scalar_type d = min_distance(_children_bound[slot], point);
+          if (count == k && !(d < distances[k - 1]))
+          {
+            return false;
+          }
+          // insertion into the sorted result arrays
+          size_type i = count < k ? count++ : k - 1;
+          for (; i > 0 && d < distances[i - 1]; --i)
+          {
+            distances[i] = distances[i - 1];
+            data_indices[i] = data_indices[i - 1];
+          }
+          distances[i] = d;
+          data_indices[i] = _children[slot];
+          return false;
+        });
+    return count;
+  }
+
+  /// `functor(t, bound, data_index)` on every value hit by the ray
+  /// `origin + t * direction` for t in [0, t_max], in no particular order;
+  /// `t` is where the ray enters the bound. returns true to stop.
+  /// returns true if the search was completed
+  template <typename PointType, typename Functor>
+  EH_RTREE_HOST_DEVICE bool raycast(PointType const& origin,
+                                    PointType const& direction,
+                                    scalar_type t_max,
+                                    Functor&& functor) const
+  {
+    scalar_type t;
+    return traverse(
+        [&](size_type slot)
+        {
+          return ray_hit(_children_bound[slot], origin, direction, t_max, t)
+                     ? 1
+                     : 0;
+        },
+        [&](size_type slot)
+        {
+          return ray_hit(_children_bound[slot], origin, direction, t_max, t)
+                 && functor(t, _children_bound[slot], _children[slot]);
+        });
+  }
+
+  /// the first value hit by the ray `origin + t * direction`
+  /// for t in [0, t_max]; prunes subtrees behind the closest hit so far.
+  /// returns false if nothing was hit
+  template <typename PointType>
+  EH_RTREE_HOST_DEVICE bool raycast_first(PointType const& origin,
+                                          PointType const& direction,
+                                          scalar_type t_max,
+                                          size_type& data_index,
+                                          scalar_type& t_hit) const
+  {
+    bool hit = false;
+    scalar_type t;
+    traverse(
+        [&](size_type slot)
+        {
+          return ray_hit(_children_bound[slot], origin, direction, t_max, t)
+                     ? 1
+                     : 0;
+        },
+        [&](size_type slot)
+        {
+          if (ray_hit(_children_bound[slot], origin, direction, t_max, t))
+          {
+            hit = true;
+            t_max = t;
+            t_hit = t;
+            data_index = _children[slot];
+          }
+          return false;
+        });
+    return hit;
+  }
+};
+
+}
+} // namespace eh, rtree
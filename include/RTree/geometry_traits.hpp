@@ -19,12 +19,14 @@ struct geometry_traits
   using scalar_type = GeometryType;
 
   // get scalar value of min_point in axis
-  static scalar_type min_point(GeometryType const& g, int axis)
+  EH_RTREE_HOST_DEVICE static scalar_type
+  min_point(GeometryType const& g, int axis)
   {
     return g;
   }
   // get scalar value of max_point in axis
-  static scalar_type max_point(GeometryType const& g, int axis)
+  EH_RTREE_HOST_DEVICE static scalar_type
+  max_point(GeometryType const& g, int axis)
   {
     return g;
   }
@@ -130,6 +132,23 @@ typename geometry_traits<Geom1>::scalar_type intersection_area(Geom1 const& g1,
   return ret;
 }
 
+// whether two bounds overlap; touching bounds are considered overlapped
+template <typename Geom1, typename Geom2>
+bool is_overlap(Geom1 const& g1, Geom2 const& g2)
+{
+  static_assert(geometry_traits<Geom1>::DIM == geometry_traits<Geom2>::DIM,
+                "Dimension not match");
+  for (int i = 0; i < geometry_traits<Geom1>::DIM; ++i)
+  {
+    if (min_point(g1, i) > max_point(g2, i)
+        || max_point(g1, i) < min_point(g2, i))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
 // area of bound
 template <typename GeometryType>
 typename geometry_traits<GeometryType>::scalar_type area(GeometryType const& g)
@@ -154,6 +173,35 @@ margin(GeometryType const& g)
   return ret;
 }
 
+// squared euclidean distance between the nearest points of two bounds;
+// zero if they overlap. used as MINDIST in nearest neighbour search
+template <typename Geom1, typename Geom2>
+typename geometry_traits<Geom1>::scalar_type min_distance(Geom1 const& g1,
+                                                          Geom2 const& g2)
+{
+  static_assert(geometry_traits<Geom1>::DIM == geometry_traits<Geom2>::DIM,
+                "Dimension not match");
+  typename geometry_traits<Geom1>::scalar_type ret = 0;
+  for (int i = 0; i < geometry_traits<Geom1>::DIM; ++i)
+  {
+    typename geometry_traits<Geom1>::scalar_type diff;
+    if (max_point(g1, i) < min_point(g2, i))
+    {
+      diff = min_point(g2, i) - max_point(g1, i);
+    }
+    else if (max_point(g2, i) < min_point(g1, i))
+    {
+      diff = min_point(g1, i) - max_point(g2, i);
+    }
+    else
+    {
+      continue;
+    }
+    ret += diff * diff;
+  }
+  return ret;
+}
+
 // distance between center of bounds
 // used in reinserting
 // returned value is used to sort the reinserted nodes,
@@ -27,6 +27,15 @@
   #define EH_RTREE_ASSERT_SILENT(x)
 #endif
 
+// functions callable from both host and device code ( CUDA, HIP )
+#ifndef EH_RTREE_HOST_DEVICE
+  #if defined(__CUDACC__) || defined(__HIPCC__)
+    #define EH_RTREE_HOST_DEVICE __host__ __device__
+  #else
+    #define EH_RTREE_HOST_DEVICE
+  #endif
+#endif
+
 namespace eh
 {
 namespace rtree
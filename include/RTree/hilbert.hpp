@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "geometry_traits.hpp"
+#include "global.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+namespace helper
+{
+
+// Hilbert index of the point `coords` on the `Dim`-dimensional Hilbert curve
+// of order `bits`; each coordinate must be in range [0, 2^bits).
+// Dim * bits must not exceed 64.
+//
+// J. Skilling (2004). "Programming the Hilbert curve".
+// AIP Conference Proceedings 707, p. 381-387.
+template <int Dim>
+std::uint64_t hilbert_index(std::uint32_t (&coords)[Dim], int bits)
+{
+  static_assert(Dim >= 1, "Invalid dimension");
+  EH_RTREE_ASSERT_SILENT(bits >= 1 && bits <= 32 && Dim * bits <= 64);
+
+  const std::uint32_t M = std::uint32_t(1) << (bits - 1);
+
+  // inverse undo excess work
+  for (std::uint32_t Q = M; Q > 1; Q >>= 1)
+  {
+    const std::uint32_t P = Q - 1;
+    for (int i = 0; i < Dim; ++i)
+    {
+      if (coords[i] & Q)
+      {
+        coords[0] ^= P;
+      }
+      else
+      {
+        const std::uint32_t t = (coords[0] ^ coords[i]) & P;
+        coords[0] ^= t;
+        coords[i] ^= t;
+      }
+    }
+  }
+
+  // gray encode
+  for (int i = 1; i < Dim; ++i)
+  {
+    coords[i] ^= coords[i - 1];
+  }
+  std::uint32_t t = 0;
+  for (std::uint32_t Q = M; Q > 1; Q >>= 1)
+  {
+    if (coords[Dim - 1] & Q)
+    {
+      t ^= Q - 1;
+    }
+  }
+  for (int i = 0; i < Dim; ++i)
+  {
+    coords[i] ^= t;
+  }
+
+  // interleave transposed bits into single index
+  std::uint64_t index = 0;
+  for (int b = bits - 1; b >= 0; --b)
+  {
+    for (int i = 0; i < Dim; ++i)
+    {
+      index = (index << 1) | ((coords[i] >> b) & 1);
+    }
+  }
+  return index;
+}
+
+}
+
+// maps center of geometries onto the Hilbert curve,
+// quantized over the given world bound.
+// used to sort geometries along the space-filling curve
+template <typename BoundType>
+class hilbert_mapper_t
+{
+public:
+  using traits = geometry_traits<BoundType>;
+  constexpr static int DIM = traits::DIM;
+
+  // bits per axis
+  constexpr static int BITS = (64 / DIM) < 32 ? (64 / DIM) : 32;
+
+protected:
+  double _min[DIM];
+  double _scale[DIM];
+  double _cells;
+
+public:
+  hilbert_mapper_t(BoundType const& world)
+      : _cells(double((std::uint64_t(1) << BITS) - 1))
+  {
+    for (int i = 0; i < DIM; ++i)
+    {
+      _min[i] = double(helper::min_point(world, i));
+      const double extent = double(helper::max_point(world, i)) - _min[i];
+      _scale[i] = extent > 0 ? _cells / extent : 0;
+    }
+  }
+
+  // hilbert index of center of `g`
+  template <typename GeometryType>
+  std::uint64_t operator()(GeometryType const& g) const
+  {
+    static_assert(geometry_traits<GeometryType>::DIM == DIM,
+                  "Dimension not match");
+    std::uint32_t coords[DIM];
+    for (int i = 0; i < DIM; ++i)
+    {
+      const double center = (double(helper::min_point(g, i))
+                             + double(helper::max_point(g, i)))
+                            * 0.5;
+      const double cell = (center - _min[i]) * _scale[i];
+      coords[i] = std::uint32_t(std::min(std::max(cell, 0.0), _cells));
+    }
+    return helper::hilbert_index<DIM>(coords, BITS);
+  }
+};
+
+}
+} // namespace eh rtree
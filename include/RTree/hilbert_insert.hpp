@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "geometry_traits.hpp"
+#include "global.hpp"
+#include "hilbert.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+namespace helper
+{
+// maps `x` to an unsigned integer of the same order
+inline std::uint64_t ordered_bits(double x)
+{
+  std::uint64_t u;
+  std::memcpy(&u, &x, sizeof(u));
+  const std::uint64_t sign = std::uint64_t(1) << 63;
+  return (u & sign) ? ~u : (u | sign);
+}
+
+// Config::insert_algorithm if defined, void otherwise
+template <typename Config, typename = void>
+struct config_insert_algorithm
+{
+  using type = void;
+};
+template <typename Config>
+struct config_insert_algorithm<Config,
+                               std::void_t<typename Config::insert_algorithm>>
+{
+  using type = typename Config::insert_algorithm;
+};
+}
+
+/*
+  Hilbert R-Tree insertion, selected by
+  `using insert_algorithm = HilbertInsert<>;` in `Config`.
+
+  Entries of every node are kept in the order of the Hilbert values of the
+  centers of their keys; the largest Hilbert value ( LHV ) of a subtree is
+  the value of its last key. A value is inserted into the leaf with the
+  smallest LHV not less than its own. An overflowing node shares its entries
+  with `CooperatingSiblings - 1` siblings, and only when all of them are
+  full, `CooperatingSiblings` nodes are split into `CooperatingSiblings + 1`
+  ( deferred 2-to-3 splitting by default ). An underflowing node borrows
+  from its siblings, or is merged into them.
+  `Config::split_algorithm` and `Config::REINSERT_COUNT` are not used.
+  `RTree::bulk_load()`, `load()` and `from_flat()` pack values in the same
+  order; keys edited in place followed by `rebound()` break it.
+
+  The default `hilbert_value()` maps each coordinate of the center through
+  its floating point bits, so no world bound is needed. For finer ordering
+  over a known world bound, derive from this struct and hide
+  `hilbert_value()`.
+
+  I. Kamel and C. Faloutsos (1994). "Hilbert R-tree: An Improved R-tree
+  using Fractals". VLDB 1994, p. 500-509.
+*/
+template <size_type CooperatingSiblings = 2>
+struct HilbertInsert
+{
+  constexpr static size_type COOPERATING_SIBLINGS = CooperatingSiblings;
+  static_assert(COOPERATING_SIBLINGS >= 1, "Invalid CooperatingSiblings");
+
+  // Hilbert value of center of `g`
+  template <typename GeometryType>
+  static std::uint64_t hilbert_value(GeometryType const& g)
+  {
+    constexpr int DIM = geometry_traits<GeometryType>::DIM;
+    constexpr int BITS = (64 / DIM) < 32 ? (64 / DIM) : 32;
+    std::uint32_t coords[DIM];
+    for (int i = 0; i < DIM; ++i)
+    {
+      const double center = (double(helper::min_point(g, i))
+                             + double(helper::max_point(g, i)))
+                            * 0.5;
+      coords[i] = std::uint32_t(helper::ordered_bits(center) >> (64 - BITS));
+    }
+    return helper::hilbert_index<DIM>(coords, BITS);
+  }
+};
+
+}
+} // namespace eh rtree
@@ -1,8 +1,13 @@
 #pragma once
 
 #include "global.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <iterator>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 namespace eh
 {
@@ -174,5 +179,289 @@ struct node_iterator_t
   }
 };
 
+// iterates through key-value pairs matching the query, lazily.
+// the traversal state is only the current leaf and element;
+// it moves up through parent pointers, so no stack is needed.
+//
+// GeometryFilter is applied to the children of non-leaf nodes, same as
+// RTree::search(); ( 1: descend, 0: skip, -1: stop the whole query ).
+// ValueFilter is applied to the elements of visited leaves;
+// only elements with `true` are yielded.
+// counters are added to `thread_query_stats()` if `Stats` is true.
+template <typename LeafType,
+          typename GeometryFilter,
+          typename ValueFilter,
+          bool Stats = false>
+struct query_iterator_t
+{
+  using this_type = query_iterator_t;
+  using child_iterator = std::conditional_t<std::is_const<LeafType>::value,
+                                            typename LeafType::const_iterator,
+                                            typename LeafType::iterator>;
+  using node_base_type
+      = std::conditional_t<std::is_const<LeafType>::value,
+                           typename LeafType::node_base_type const,
+                           typename LeafType::node_base_type>;
+
+  using value_type = typename std::iterator_traits<child_iterator>::value_type;
+  using difference_type = std::make_signed_t<typename LeafType::size_type>;
+
+  using reference = typename std::iterator_traits<child_iterator>::reference;
+  using pointer = typename std::iterator_traits<child_iterator>::pointer;
+
+  using iterator_category = std::forward_iterator_tag;
+
+  pointer _pointer = nullptr;
+  LeafType* _leaf = nullptr;
+  int _leaf_level = 0;
+
+  GeometryFilter _geometry_filter;
+  ValueFilter _value_filter;
+
+  // end iterator
+  query_iterator_t(GeometryFilter geometry_filter, ValueFilter value_filter)
+      : _geometry_filter(std::move(geometry_filter))
+      , _value_filter(std::move(value_filter))
+  {
+  }
+  // first matching element in the tree
+  query_iterator_t(node_base_type* root,
+                   int leaf_level,
+                   GeometryFilter geometry_filter,
+                   ValueFilter value_filter)
+      : _leaf_level(leaf_level)
+      , _geometry_filter(std::move(geometry_filter))
+      , _value_filter(std::move(value_filter))
+  {
+    seek(root, 0, 0);
+  }
+
+  bool operator==(this_type const& rhs) const
+  {
+    return _pointer == rhs._pointer;
+  }
+  bool operator!=(this_type const& rhs) const
+  {
+    return _pointer != rhs._pointer;
+  }
+
+  LeafType* node() const
+  {
+    return _leaf;
+  }
+
+  // calls `functor(thread_query_stats())` only if `Stats` is true
+  template <typename Functor>
+  static void record_stats(Functor&& functor)
+  {
+    if constexpr (Stats)
+    {
+      functor(thread_query_stats());
+    }
+  }
+
+  // find next matching element,
+  // starting from `index`-th child of `node` on `level`.
+  // a node entered from its first child counts as visited
+  void seek(node_base_type* node, typename LeafType::size_type index, int level)
+  {
+    while (true)
+    {
+      if (level == _leaf_level)
+      {
+        LeafType* leaf = node->as_leaf();
+        if (index == 0)
+        {
+          record_stats([&](query_stats& stats) { ++stats.leaves_visited; });
+        }
+        for (; index < leaf->size(); ++index)
+        {
+          record_stats([&](query_stats& stats) { ++stats.entries_scanned; });
+          if (_value_filter(leaf->at(index)))
+          {
+            record_stats([&](query_stats& stats) { ++stats.results; });
+            _leaf = leaf;
+            _pointer = &leaf->at(index);
+            return;
+          }
+        }
+      }
+      else
+      {
+        auto* n = node->as_node();
+        if (index == 0)
+        {
+          record_stats([&](query_stats& stats) { ++stats.nodes_visited; });
+        }
+        bool descend = false;
+        for (; index < n->size(); ++index)
+        {
+          record_stats([&](query_stats& stats) { ++stats.filter_calls; });
+          const int filtered = _geometry_filter(n->at(index).first);
+          if (filtered == -1)
+          {
+            _leaf = nullptr;
+            _pointer = nullptr;
+            return;
+          }
+          if (filtered == 1)
+          {
+            descend = true;
+            break;
+          }
+          record_stats(
+              [&](query_stats& stats)
+              {
+                stats.max_prune_depth
+                    = std::max(stats.max_prune_depth, level + 1);
+              });
+        }
+        if (descend)
+        {
+          node = n->at(index).second;
+          index = 0;
+          ++level;
+          continue;
+        }
+      }
+
+      // every child of node is exhausted; move to the next sibling
+      if (node->parent() == nullptr)
+      {
+        _leaf = nullptr;
+        _pointer = nullptr;
+        return;
+      }
+      index = node->_index_on_parent + 1;
+      node = node->parent();
+      --level;
+    }
+  }
+
+  this_type& operator++()
+  {
+    seek(_leaf, (_pointer - _leaf->data()) + 1, _leaf_level);
+    return *this;
+  }
+  this_type operator++(int)
+  {
+    this_type ret = *this;
+    operator++();
+    return ret;
+  }
+
+  reference operator*() const
+  {
+    return *_pointer;
+  }
+  pointer operator->() const
+  {
+    return _pointer;
+  }
+};
+
+// position of query_iterator_t, saved by RTree::query_token().
+// can be encoded into compact byte string to resume the query later,
+// e.g. on the next page of results.
+struct query_token_t
+{
+  // modification epoch of the tree when the token was saved
+  std::uint64_t epoch = 0;
+
+  // child index on each level, from root to the current element.
+  // empty if the query was finished
+  std::vector<size_type> path;
+
+  // encode into byte string of LEB128 variable-length integers
+  std::string encode() const
+  {
+    std::string bytes;
+    auto put = [&](std::uint64_t value)
+    {
+      while (value >= 0x80)
+      {
+        bytes.push_back(char((value & 0x7f) | 0x80));
+        value >>= 7;
+      }
+      bytes.push_back(char(value));
+    };
+    put(epoch);
+    put(path.size());
+    for (size_type index : path)
+    {
+      put(index);
+    }
+    return bytes;
+  }
+
+  // decode from byte string; returns false if it is malformed
+  bool decode(std::string const& bytes)
+  {
+    std::size_t pos = 0;
+    auto get = [&](std::uint64_t& value)
+    {
+      value = 0;
+      for (int shift = 0; shift < 64; shift += 7)
+      {
+        if (pos == bytes.size())
+        {
+          return false;
+        }
+        const std::uint64_t byte = std::uint8_t(bytes[pos++]);
+        value |= (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+          return true;
+        }
+      }
+      return false;
+    };
+
+    std::uint64_t count;
+    if (!get(epoch) || !get(count) || count > bytes.size() - pos)
+    {
+      return false;
+    }
+    path.resize(count);
+    for (size_type& index : path)
+    {
+      std::uint64_t value;
+      if (!get(value))
+      {
+        return false;
+      }
+      index = size_type(value);
+    }
+    return pos == bytes.size();
+  }
+};
+
+// ValueFilter yielding every element
+struct accept_all_t
+{
+  template <typename ValueType>
+  bool operator()(ValueType const&) const
+  {
+    return true;
+  }
+};
+
+// [begin, end) pair, for range-based for loop
+template <typename IteratorType>
+struct range_t
+{
+  IteratorType _begin;
+  IteratorType _end;
+
+  IteratorType begin() const
+  {
+    return _begin;
+  }
+  IteratorType end() const
+  {
+    return _end;
+  }
+};
+
+}
 }
-}
\ No newline at end of file
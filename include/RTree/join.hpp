@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "geometry_traits.hpp"
+#include "global.hpp"
+#include "metric.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+// (distance, iterator on tree A, iterator on tree B) of closest pair query
+template <typename TreeA, typename TreeB>
+struct closest_pair_t
+{
+  using scalar_type = typename TreeA::scalar_type;
+
+  scalar_type distance;
+  typename TreeA::const_iterator first;
+  typename TreeB::const_iterator second;
+};
+
+namespace helper
+{
+// bounding box of the root node; tree must not be empty
+template <typename TreeType>
+typename TreeType::geometry_type root_bound(TreeType const& tree)
+{
+  if (tree.leaf_level() == 0)
+  {
+    return tree.root()->as_leaf()->calculate_bound();
+  }
+  return tree.root()->calculate_bound();
+}
+}
+
+// k closest pairs between values of tree `a` and `b`,
+// in increasing order of distance between their keys, measured by `metric`.
+// writes `closest_pair_t<TreeA, TreeB>` to `out` and returns the number of
+// pairs written.
+//
+// Both trees are traversed simultaneously best-first,
+// ordered by the distance between bounding boxes of node pairs (MINMINDIST).
+//
+// A. Corral, Y. Manolopoulos, Y. Theodoridis, M. Vassilakopoulos (2000).
+// "Closest Pair Queries in Spatial Databases". SIGMOD '00. p. 189-200.
+template <typename TreeA,
+          typename TreeB,
+          typename OutputIterator,
+          typename Metric = EuclideanMetric>
+size_type closest_pairs(TreeA const& a,
+                        TreeB const& b,
+                        size_type k,
+                        OutputIterator out,
+                        Metric const& metric = Metric())
+{
+  static_assert(geometry_traits<typename TreeA::geometry_type>::DIM
+                    == geometry_traits<typename TreeB::geometry_type>::DIM,
+                "Dimension not match");
+
+  using scalar_type = typename TreeA::scalar_type;
+  using pair_type = closest_pair_t<TreeA, TreeB>;
+  using node_a_type = typename TreeA::node_base_type;
+  using node_b_type = typename TreeB::node_base_type;
+
+  struct candidate_t
+  {
+    scalar_type distance;
+    node_a_type const* node_a;
+    node_b_type const* node_b;
+    typename TreeA::geometry_type bound_a;
+    typename TreeB::geometry_type bound_b;
+    int level_a;
+    int level_b;
+  };
+  auto candidate_greater = [](candidate_t const& x, candidate_t const& y)
+  { return x.distance > y.distance; };
+  auto result_less = [](pair_type const& x, pair_type const& y)
+  { return x.distance < y.distance; };
+
+  if (k == 0 || a.empty() || b.empty())
+  {
+    return 0;
+  }
+
+  std::vector<candidate_t> candidates;
+  std::vector<pair_type> results;
+
+  candidates.push_back({ scalar_type(0), a.root(), b.root(),
+                         helper::root_bound(a), helper::root_bound(b), 0,
+                         0 });
+  while (!candidates.empty())
+  {
+    std::pop_heap(candidates.begin(), candidates.end(), candidate_greater);
+    const candidate_t c = candidates.back();
+    candidates.pop_back();
+
+    if (results.size() == k && c.distance >= results.front().distance)
+    {
+      break;
+    }
+
+    const bool leaf_a = c.level_a == a.leaf_level();
+    const bool leaf_b = c.level_b == b.leaf_level();
+    if (leaf_a && leaf_b)
+    {
+      for (auto const& ea : *c.node_a->as_leaf())
+      {
+        for (auto const& eb : *c.node_b->as_leaf())
+        {
+          const scalar_type d = metric.distance(ea.first, eb.first);
+          const pair_type p {
+            d, typename TreeA::const_iterator(&ea, c.node_a->as_leaf()),
+            typename TreeB::const_iterator(&eb, c.node_b->as_leaf())
+          };
+          if (results.size() < k)
+          {
+            results.push_back(p);
+            std::push_heap(results.begin(), results.end(), result_less);
+          }
+          else if (d < results.front().distance)
+          {
+            std::pop_heap(results.begin(), results.end(), result_less);
+            results.back() = p;
+            std::push_heap(results.begin(), results.end(), result_less);
+          }
+        }
+      }
+      continue;
+    }
+
+    auto push = [&](candidate_t next)
+    {
+      next.distance = metric.min_distance(next.bound_a, next.bound_b);
+      if (results.size() < k || next.distance < results.front().distance)
+      {
+        candidates.push_back(next);
+        std::push_heap(candidates.begin(), candidates.end(),
+                       candidate_greater);
+      }
+    };
+    if (leaf_a)
+    {
+      // expand b only
+      for (auto const& cb : *c.node_b->as_node())
+      {
+        push({ 0, c.node_a, cb.second, c.bound_a, cb.first, c.level_a,
+               c.level_b + 1 });
+      }
+    }
+    else if (leaf_b)
+    {
+      // expand a only
+      for (auto const& ca : *c.node_a->as_node())
+      {
+        push({ 0, ca.second, c.node_b, ca.first, c.bound_b, c.level_a + 1,
+               c.level_b });
+      }
+    }
+    else
+    {
+      // expand both simultaneously
+      for (auto const& ca : *c.node_a->as_node())
+      {
+        for (auto const& cb : *c.node_b->as_node())
+        {
+          push({ 0, ca.second, cb.second, ca.first, cb.first, c.level_a + 1,
+                 c.level_b + 1 });
+        }
+      }
+    }
+  }
+  std::sort_heap(results.begin(), results.end(), result_less);
+  std::copy(results.begin(), results.end(), out);
+  return results.size();
+}
+
+namespace helper
+{
+// state of knn_join;
+// pairs of nodes (A, B) are visited depth-first, the deeper subtree split first
+template <typename TreeA, typename TreeB, typename Metric>
+struct knn_join_t
+{
+  using scalar_type = typename TreeB::scalar_type;
+  using result_type = typename TreeB::nearest_value_type;
+  using node_a_type = typename TreeA::node_base_type;
+  using node_b_type = typename TreeB::node_base_type;
+  using bound_a_type = typename TreeA::geometry_type;
+  using bound_b_type = typename TreeB::geometry_type;
+
+  TreeA const& a;
+  TreeB const& b;
+  size_type k;
+  Metric const& metric;
+
+  // largest k-th distance found so far among values under each node of A
+  std::unordered_map<node_a_type const*, scalar_type> bounds;
+  // max-heap of k nearest values found so far, for each value of leaves of A
+  std::unordered_map<node_a_type const*, std::vector<std::vector<result_type>>>
+      results;
+
+  static bool result_less(result_type const& x, result_type const& y)
+  {
+    return x.first < y.first;
+  }
+
+  scalar_type bound(node_a_type const* node) const
+  {
+    auto it = bounds.find(node);
+    return it == bounds.end() ? std::numeric_limits<scalar_type>::max()
+                              : it->second;
+  }
+
+  void join(node_a_type const* node_a,
+            bound_a_type const& bound_a,
+            int level_a,
+            node_b_type const* node_b,
+            bound_b_type const& bound_b,
+            int level_b)
+  {
+    if (metric.min_distance(bound_b, bound_a) >= bound(node_a))
+    {
+      return;
+    }
+
+    const int height_a = a.leaf_level() - level_a;
+    const int height_b = b.leaf_level() - level_b;
+    if (height_a == 0 && height_b == 0)
+    {
+      join_leaves(node_a, node_b, bound_b);
+    }
+    else if (height_b >= height_a)
+    {
+      // expand b, nearest child first to tighten the bound of node_a early
+      std::vector<std::pair<scalar_type, size_type>> order;
+      auto const* node = node_b->as_node();
+      for (size_type i = 0; i < node->size(); ++i)
+      {
+        order.emplace_back(metric.min_distance(node->at(i).first, bound_a),
+                           i);
+      }
+      std::sort(order.begin(), order.end());
+      for (auto const& o : order)
+      {
+        if (o.first >= bound(node_a))
+        {
+          break;
+        }
+        join(node_a, bound_a, level_a, node->at(o.second).second,
+             node->at(o.second).first, level_b + 1);
+      }
+    }
+    else
+    {
+      // expand a; its bound is the largest bound of its children
+      scalar_type new_bound = std::numeric_limits<scalar_type>::lowest();
+      for (auto const& ca : *node_a->as_node())
+      {
+        join(ca.second, ca.first, level_a + 1, node_b, bound_b, level_b);
+        new_bound = std::max(new_bound, bound(ca.second));
+      }
+      bounds[node_a] = new_bound;
+    }
+  }
+
+  void join_leaves(node_a_type const* node_a,
+                   node_b_type const* node_b,
+                   bound_b_type const& bound_b)
+  {
+    auto const* leaf_a = node_a->as_leaf();
+    auto const* leaf_b = node_b->as_leaf();
+    std::vector<std::vector<result_type>>& leaf_results = results[node_a];
+    leaf_results.resize(leaf_a->size());
+
+    scalar_type new_bound = std::numeric_limits<scalar_type>::lowest();
+    for (size_type i = 0; i < leaf_a->size(); ++i)
+    {
+      auto const& key = leaf_a->at(i).first;
+      std::vector<result_type>& r = leaf_results[i];
+      if (r.size() < k || metric.min_distance(bound_b, key) < r.front().first)
+      {
+        for (auto const& eb : *leaf_b)
+        {
+          const scalar_type d = metric.distance(eb.first, key);
+          if (r.size() < k)
+          {
+            r.emplace_back(d, typename TreeB::const_iterator(&eb, leaf_b));
+            std::push_heap(r.begin(), r.end(), result_less);
+          }
+          else if (d < r.front().first)
+          {
+            std::pop_heap(r.begin(), r.end(), result_less);
+            r.back() = { d, typename TreeB::const_iterator(&eb, leaf_b) };
+            std::push_heap(r.begin(), r.end(), result_less);
+          }
+        }
+      }
+      new_bound = std::max(new_bound,
+                           r.size() < k
+                               ? std::numeric_limits<scalar_type>::max()
+                               : r.front().first);
+    }
+    bounds[node_a] = new_bound;
+  }
+};
+}
+
+// k nearest neighbour join;
+// for each value of tree `a`, find its k nearest values in tree `b`.
+// `join_functor(a_iterator, neighbours)` is called for every value of `a`,
+// in leaf order, where `neighbours` is std::vector of
+// `TreeB::nearest_value_type` sorted by increasing distance.
+// If the return value is `true`, the join will immediately stop.
+//
+// Both trees are traversed simultaneously, depth-first over node pairs,
+// visiting children of `b` in increasing distance (MINMINDIST).
+// Every node of `a` keeps the largest k-th distance found so far among its
+// values; a pair is pruned once its distance reaches that bound,
+// so a subtree of `b` is skipped for a whole subtree of `a` at once.
+// Neighbours of every value of `a` are held until the traversal ends,
+// taking O(size of `a` * k) memory.
+//
+// R. Curtin, W. March, P. Ram, D. Anderson, A. Gray, C. Isbell (2013).
+// "Tree-Independent Dual-Tree Algorithms". ICML '13.
+template <typename TreeA,
+          typename TreeB,
+          typename JoinFunctor,
+          typename Metric = EuclideanMetric>
+void knn_join(TreeA const& a,
+              TreeB const& b,
+              size_type k,
+              JoinFunctor&& join_functor,
+              Metric const& metric = Metric())
+{
+  static_assert(geometry_traits<typename TreeA::geometry_type>::DIM
+                    == geometry_traits<typename TreeB::geometry_type>::DIM,
+                "Dimension not match");
+
+  using join_type = helper::knn_join_t<TreeA, TreeB, Metric>;
+  using result_type = typename join_type::result_type;
+
+  if (k == 0 || a.empty())
+  {
+    return;
+  }
+
+  join_type join { a, b, k, metric, {}, {} };
+  if (!b.empty())
+  {
+    join.join(a.root(), helper::root_bound(a), 0, b.root(),
+              helper::root_bound(b), 0);
+  }
+
+  for (auto li = a.leaf_begin(); li != a.leaf_end(); ++li)
+  {
+    auto const* leaf = *li;
+    std::vector<std::vector<result_type>>& results = join.results[leaf];
+    results.resize(leaf->size());
+    for (size_type i = 0; i < leaf->size(); ++i)
+    {
+      std::sort_heap(results[i].begin(), results[i].end(),
+                     join_type::result_less);
+      if (join_functor(typename TreeA::const_iterator(&leaf->at(i), leaf),
+                       results[i]))
+      {
+        return;
+      }
+    }
+  }
+}
+
+}
+} // namespace eh rtree
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+
+#include "geometry_traits.hpp"
+#include "global.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+/*
+  Distance metrics for nearest neighbour query.
+  Every metric must implement
+
+  // lower bound of distance from `query` to any geometry inside `bound`
+  // (MINDIST); used to order and prune nodes
+  template <typename Bound, typename Query>
+  scalar_type min_distance(Bound const& bound, Query const& query) const;
+
+  // distance from `query` to `key` of inserted value
+  template <typename Key, typename Query>
+  scalar_type distance(Key const& key, Query const& query) const;
+
+  `min_distance` must never exceed `distance` to any key inside `bound`.
+  Any user-defined type with these two member functions can be used as metric.
+*/
+
+namespace helper
+{
+// distance between two bounds along the given axis;
+// zero if they overlap on the axis
+template <typename Geom1, typename Geom2>
+typename geometry_traits<Geom1>::scalar_type
+axis_gap(Geom1 const& g1, Geom2 const& g2, int axis)
+{
+  if (max_point(g1, axis) < min_point(g2, axis))
+  {
+    return min_point(g2, axis) - max_point(g1, axis);
+  }
+  if (max_point(g2, axis) < min_point(g1, axis))
+  {
+    return min_point(g1, axis) - max_point(g2, axis);
+  }
+  return 0;
+}
+}
+
+// squared euclidean distance
+struct EuclideanMetric
+{
+  template <typename Bound, typename Query>
+  typename geometry_traits<Bound>::scalar_type
+  min_distance(Bound const& bound, Query const& query) const
+  {
+    return helper::min_distance(bound, query);
+  }
+  template <typename Key, typename Query>
+  typename geometry_traits<Key>::scalar_type distance(Key const& key,
+                                                      Query const& query) const
+  {
+    return helper::min_distance(key, query);
+  }
+};
+
+// manhattan (L1) distance
+struct ManhattanMetric
+{
+  template <typename Bound, typename Query>
+  typename geometry_traits<Bound>::scalar_type
+  min_distance(Bound const& bound, Query const& query) const
+  {
+    static_assert(geometry_traits<Bound>::DIM == geometry_traits<Query>::DIM,
+                  "Dimension not match");
+    typename geometry_traits<Bound>::scalar_type ret = 0;
+    for (int i = 0; i < geometry_traits<Bound>::DIM; ++i)
+    {
+      ret += helper::axis_gap(bound, query, i);
+    }
+    return ret;
+  }
+  template <typename Key, typename Query>
+  typename geometry_traits<Key>::scalar_type distance(Key const& key,
+                                                      Query const& query) const
+  {
+    return min_distance(key, query);
+  }
+};
+
+// chebyshev (L-infinity) distance
+struct ChebyshevMetric
+{
+  template <typename Bound, typename Query>
+  typename geometry_traits<Bound>::scalar_type
+  min_distance(Bound const& bound, Query const& query) const
+  {
+    static_assert(geometry_traits<Bound>::DIM == geometry_traits<Query>::DIM,
+                  "Dimension not match");
+    typename geometry_traits<Bound>::scalar_type ret = 0;
+    for (int i = 0; i < geometry_traits<Bound>::DIM; ++i)
+    {
+      ret = std::max(ret, helper::axis_gap(bound, query, i));
+    }
+    return ret;
+  }
+  template <typename Key, typename Query>
+  typename geometry_traits<Key>::scalar_type distance(Key const& key,
+                                                      Query const& query) const
+  {
+    return min_distance(key, query);
+  }
+};
+
+// squared euclidean distance with per-axis weights
+template <typename ScalarType, int Dim>
+struct WeightedEuclideanMetric
+{
+  // non-negative weight for each axis
+  ScalarType weights[Dim];
+
+  template <typename Bound, typename Query>
+  typename geometry_traits<Bound>::scalar_type
+  min_distance(Bound const& bound, Query const& query) const
+  {
+    static_assert(geometry_traits<Bound>::DIM == Dim, "Dimension not match");
+    static_assert(geometry_traits<Query>::DIM == Dim, "Dimension not match");
+    typename geometry_traits<Bound>::scalar_type ret = 0;
+    for (int i = 0; i < Dim; ++i)
+    {
+      const auto gap = helper::axis_gap(bound, query, i);
+      ret += weights[i] * gap * gap;
+    }
+    return ret;
+  }
+  template <typename Key, typename Query>
+  typename geometry_traits<Key>::scalar_type distance(Key const& key,
+                                                      Query const& query) const
+  {
+    return min_distance(key, query);
+  }
+};
+
+}
+} // namespace eh rtree
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "geometry_traits.hpp"
+#include "global.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+// structural quality of nodes on a single level of the tree.
+// every area is measured on the children of the nodes, i.e. for leaf nodes,
+// on the keys of the inserted values
+struct level_quality_t
+{
+  // buckets of aspect ratio (longest / shortest extent of node bound):
+  // [1,2), [2,4), [4,8), [8,16), [16,inf), and degenerate (zero extent)
+  constexpr static int ASPECT_BUCKETS = 6;
+
+  size_type node_count = 0;
+  // number of children / MAX_ENTRIES
+  double average_fill = 0;
+  double min_fill = 0;
+  // area covered by two or more children of the same node
+  double overlap = 0;
+  // sum of intersection area of every pair of children of the same node
+  double pairwise_overlap = 0;
+  // area of node bound not covered by any of its children
+  double dead_space = 0;
+  // sum of margins of node bounds
+  double margin = 0;
+  size_type aspect_ratio[ASPECT_BUCKETS] = {};
+};
+
+// quality per level; levels[0] is the root, levels.back() the leaves
+struct quality_report_t
+{
+  std::vector<level_quality_t> levels;
+};
+
+namespace helper
+{
+
+template <int Dim>
+struct quality_box_t
+{
+  double min[Dim];
+  double max[Dim];
+};
+
+template <int Dim, typename GeometryType>
+quality_box_t<Dim> to_quality_box(GeometryType const& g)
+{
+  static_assert(geometry_traits<GeometryType>::DIM == Dim,
+                "Dimension not match");
+  quality_box_t<Dim> ret;
+  for (int i = 0; i < Dim; ++i)
+  {
+    ret.min[i] = double(min_point(g, i));
+    ret.max[i] = double(max_point(g, i));
+  }
+  return ret;
+}
+
+// area covered by at least `min_count` of `boxes`;
+// boxes are cut into slabs along each axis, from `axis` to the last one
+template <int Dim>
+double coverage_area(std::vector<quality_box_t<Dim> const*> const& boxes,
+                     size_type min_count,
+                     int axis = 0)
+{
+  if (boxes.size() < min_count)
+  {
+    return 0;
+  }
+  if (axis == Dim)
+  {
+    return 1;
+  }
+  std::vector<double> cuts;
+  cuts.reserve(boxes.size() * 2);
+  for (quality_box_t<Dim> const* b : boxes)
+  {
+    cuts.push_back(b->min[axis]);
+    cuts.push_back(b->max[axis]);
+  }
+  std::sort(cuts.begin(), cuts.end());
+  cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+  double ret = 0;
+  std::vector<quality_box_t<Dim> const*> active;
+  for (size_type i = 0; i + 1 < cuts.size(); ++i)
+  {
+    active.clear();
+    for (quality_box_t<Dim> const* b : boxes)
+    {
+      if (b->min[axis] <= cuts[i] && b->max[axis] >= cuts[i + 1])
+      {
+        active.push_back(b);
+      }
+    }
+    ret += (cuts[i + 1] - cuts[i]) * coverage_area(active, min_count, axis + 1);
+  }
+  return ret;
+}
+
+// accumulate a node with bound `bound` and child bounds in [first, last)
+// into `level`; average_fill holds the sum of fills until finished
+template <typename GeometryType, typename ChildIterator>
+void add_node_quality(level_quality_t& level,
+                      GeometryType const& bound,
+                      ChildIterator first,
+                      ChildIterator last,
+                      size_type max_entries)
+{
+  constexpr int DIM = geometry_traits<GeometryType>::DIM;
+
+  std::vector<quality_box_t<DIM>> children;
+  for (; first != last; ++first)
+  {
+    children.push_back(to_quality_box<DIM>(first->first));
+  }
+  std::vector<quality_box_t<DIM> const*> pointers;
+  for (quality_box_t<DIM> const& c : children)
+  {
+    pointers.push_back(&c);
+  }
+
+  const double fill = double(children.size()) / double(max_entries);
+  level.min_fill = level.node_count ? std::min(level.min_fill, fill) : fill;
+  level.average_fill += fill;
+  ++level.node_count;
+
+  level.overlap += coverage_area(pointers, 2);
+  for (size_type i = 0; i < children.size(); ++i)
+  {
+    for (size_type j = i + 1; j < children.size(); ++j)
+    {
+      double intersection = 1;
+      for (int a = 0; a < DIM; ++a)
+      {
+        const double lo = std::max(children[i].min[a], children[j].min[a]);
+        const double hi = std::min(children[i].max[a], children[j].max[a]);
+        intersection *= std::max(0.0, hi - lo);
+      }
+      level.pairwise_overlap += intersection;
+    }
+  }
+  level.dead_space += double(area(bound)) - coverage_area(pointers, 1);
+  level.margin += double(margin(bound));
+
+  double longest = 0;
+  double shortest = 0;
+  for (int a = 0; a < DIM; ++a)
+  {
+    const double extent = double(max_point(bound, a) - min_point(bound, a));
+    longest = a ? std::max(longest, extent) : extent;
+    shortest = a ? std::min(shortest, extent) : extent;
+  }
+  int bucket = level_quality_t::ASPECT_BUCKETS - 1;
+  if (shortest > 0)
+  {
+    bucket = std::min(int(std::log2(longest / shortest)),
+                      level_quality_t::ASPECT_BUCKETS - 2);
+  }
+  ++level.aspect_ratio[bucket];
+}
+
+}
+
+}
+} // namespace eh rtree
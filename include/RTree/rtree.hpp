@@ -1,17 +1,31 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <thread>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "flat_view.hpp"
 #include "geometry_traits.hpp"
+#include "bulk_load.hpp"
 #include "global.hpp"
+#include "hilbert.hpp"
+#include "hilbert_insert.hpp"
 #include "iterator.hpp"
+#include "metric.hpp"
+#include "quality.hpp"
+#include "serialize.hpp"
 #include "static_node.hpp"
+#include "stats.hpp"
 
 #include "rstar_split.hpp"
 
@@ -66,6 +80,18 @@ public:
   static_assert(MAX_ENTRIES + 1 - Config::REINSERT_COUNT <= MAX_ENTRIES,
                 "Invalid REINSERT_COUNT count");
 
+  // collect statistics into `thread_query_stats()`, `thread_modify_stats()`
+  constexpr static bool STATS = helper::config_stats<Config>::value;
+  // call `Config::event_hook::on_modify()` on structural changes
+  constexpr static bool EVENT_HOOK = helper::config_event_hook<Config>::value;
+  constexpr static bool MODIFY_EVENTS = STATS || EVENT_HOOK;
+
+  // `Config::insert_algorithm` if defined; void for R*-Tree insertion
+  using insert_algorithm =
+      typename helper::config_insert_algorithm<Config>::type;
+  // keep entries in Hilbert order; see hilbert_insert.hpp
+  constexpr static bool HILBERT_INSERT = !std::is_void<insert_algorithm>::value;
+
   // using stack memory for MaxEntries child nodes. instead of std::vector
   using node_base_type = static_node_base_t<GeometryType,
                                             KeyType,
@@ -96,15 +122,63 @@ public:
   using leaf_iterator = node_iterator_t<leaf_type>;
   using const_leaf_iterator = node_iterator_t<leaf_type const>;
 
+  template <typename GeometryFilter, typename ValueFilter = accept_all_t>
+  using query_iterator
+      = query_iterator_t<leaf_type, GeometryFilter, ValueFilter, STATS>;
+  template <typename GeometryFilter, typename ValueFilter = accept_all_t>
+  using const_query_iterator
+      = query_iterator_t<leaf_type const, GeometryFilter, ValueFilter, STATS>;
+
 protected:
   node_base_type* _root = nullptr;
   int _leaf_level = 0;
 
+  // increased on every modification of the tree structure;
+  // the upper 32 bits identify the tree, so tokens of other trees do not
+  // match
+  std::uint64_t _epoch = epoch_seed();
+
+  static std::uint64_t epoch_seed()
+  {
+    static std::atomic<std::uint64_t> trees { 0 };
+    return trees.fetch_add(1, std::memory_order_relaxed) << 32;
+  }
+
+  // nodes changed since the last `flatten_update()`, and where every node
+  // lives in the flattened buffers; only maintained after the first
+  // `flatten_update()`
+  struct flat_tracker_t
+  {
+    // slots and values owned by a flattened node
+    struct region_t
+    {
+      size_type slot_offset;
+      size_type slot_capacity;
+      size_type data_offset;
+      size_type data_capacity;
+      // slots in use
+      size_type size;
+    };
+
+    bool active = false;
+    std::uint64_t generation = 0;
+    // sum of `size` of every tracked region; decides when to rebuild
+    // without walking the tree
+    size_type live_slots = 0;
+    std::unordered_set<node_base_type const*> dirty;
+    std::unordered_map<node_base_type const*, size_type> index;
+    // by index on flattened `nodes`; nullptr if destroyed
+    std::vector<node_base_type const*> nodes;
+    std::vector<region_t> regions;
+  };
+  flat_tracker_t _flat_tracker;
+
   node_allocator_type _node_allocator;
   leaf_allocator_type _leaf_allocator;
 
   void delete_if()
   {
+    flat_untrack();
     if (_root)
     {
       if (_leaf_level == 0)
@@ -122,8 +196,56 @@ protected:
   }
   void set_null()
   {
+    flat_untrack();
     _root = nullptr;
     _leaf_level = 0;
+    ++_epoch;
+  }
+
+  void flat_untrack()
+  {
+    if (_flat_tracker.active)
+    {
+      _flat_tracker = flat_tracker_t();
+    }
+  }
+  // record of `node` in the flattened buffers has changed
+  void flat_mark(node_base_type const* node)
+  {
+    if (_flat_tracker.active)
+    {
+      _flat_tracker.dirty.insert(node);
+    }
+  }
+  // parent index of every child of `node` has changed
+  void flat_mark_children(node_type const* node)
+  {
+    if (_flat_tracker.active)
+    {
+      for (auto const& c : *node)
+      {
+        _flat_tracker.dirty.insert(c.second);
+      }
+    }
+  }
+  void flat_mark_children(leaf_type const*)
+  {
+  }
+  void flat_forget(node_base_type const* node)
+  {
+    if (_flat_tracker.active)
+    {
+      _flat_tracker.dirty.erase(node);
+      auto it = _flat_tracker.index.find(node);
+      if (it != _flat_tracker.index.end())
+      {
+        auto& region = _flat_tracker.regions[it->second];
+        _flat_tracker.live_slots -= region.size;
+        region.size = 0;
+        _flat_tracker.nodes[it->second] = nullptr;
+        _flat_tracker.index.erase(it);
+      }
+    }
   }
 
   void init_root()
@@ -135,6 +257,50 @@ protected:
     }
   }
 
+  // level counted upward from the leaves
+  int height_of(leaf_type const*) const
+  {
+    return 0;
+  }
+  int height_of(node_type const* node) const
+  {
+    return _leaf_level - node->level_recursive();
+  }
+
+  // updates `thread_modify_stats()` and calls `Config::event_hook`;
+  // callers guard with `if constexpr (MODIFY_EVENTS)`
+  static void notify(modify_event_t event, int height, size_type count)
+  {
+    if constexpr (STATS)
+    {
+      modify_stats& stats = thread_modify_stats();
+      switch (event)
+      {
+      case modify_event_t::split:
+        ++stats.splits[std::min(height, modify_stats::MAX_HEIGHT - 1)];
+        break;
+      case modify_event_t::forced_reinsert:
+        ++stats.forced_reinserts;
+        stats.reinserted_entries += count;
+        break;
+      case modify_event_t::erase_reinsert:
+        ++stats.erase_orphaned_nodes;
+        stats.erase_reinserted_entries += count;
+        break;
+      case modify_event_t::root_grow:
+        ++stats.root_grows;
+        break;
+      case modify_event_t::root_shrink:
+        ++stats.root_shrinks;
+        break;
+      }
+    }
+    if constexpr (EVENT_HOOK)
+    {
+      Config::event_hook::on_modify(event, height, count);
+    }
+  }
+
   // search for appropriate node in target_level to insert bound
   node_type* choose_insert_target(geometry_type const& bound, int target_level)
   {
@@ -160,6 +326,10 @@ protected:
     {
       scalar_type min_area_enlarge = std::numeric_limits<scalar_type>::max();
       typename node_type::iterator chosen = n->end();
+      if constexpr (STATS)
+      {
+        thread_modify_stats().choose_subtree_comparisons += n->size();
+      }
 
       for (typename node_type::iterator ci = n->begin(); ci != n->end(); ++ci)
       {
@@ -190,6 +360,11 @@ protected:
                    typename NodeType::value_type new_child,
                    bool reinsert)
   {
+    flat_mark(parent);
+    if constexpr (std::is_same<NodeType, node_type>::value)
+    {
+      flat_mark(new_child.second);
+    }
     NodeType* pair = nullptr;
     if (parent->size() == MAX_ENTRIES)
     {
@@ -222,7 +397,12 @@ protected:
         new_root->insert({ parent->calculate_bound(), parent });
         new_root->insert({ pair->calculate_bound(), pair });
         _root = new_root;
+        flat_mark(new_root);
         ++_leaf_level;
+        if constexpr (MODIFY_EVENTS)
+        {
+          notify(modify_event_t::root_grow, _leaf_level, 2);
+        }
       }
       else
       {
@@ -249,9 +429,17 @@ protected:
   template <typename NodeType>
   NodeType* split(NodeType* node, typename NodeType::value_type child)
   {
+    if constexpr (MODIFY_EVENTS)
+    {
+      notify(modify_event_t::split, height_of(node), MAX_ENTRIES + 1);
+    }
     NodeType* pair = construct_node<NodeType>();
     // @TODO another split scheme
     Config::split_algorithm::split(node, std::move(child), pair);
+    flat_mark(node);
+    flat_mark(pair);
+    flat_mark_children(node);
+    flat_mark_children(pair);
     return pair;
   }
 
@@ -287,6 +475,11 @@ protected:
 
     const int node_realtive_level_from_leaf
         = leaf_level() - node->level_recursive();
+    if constexpr (MODIFY_EVENTS)
+    {
+      notify(modify_event_t::forced_reinsert, node_realtive_level_from_leaf,
+             Config::REINSERT_COUNT);
+    }
 
     geometry_type node_bound = node->calculate_bound();
     helper::enlarge_to(node_bound, child.first);
@@ -323,6 +516,10 @@ protected:
   }
   void reinsert(leaf_type* node, typename leaf_type::value_type child)
   {
+    if constexpr (MODIFY_EVENTS)
+    {
+      notify(modify_event_t::forced_reinsert, 0, Config::REINSERT_COUNT);
+    }
     geometry_type node_bound = node->calculate_bound();
     helper::enlarge_to(node_bound, child.first);
     std::vector<typename leaf_type::value_type> children;
@@ -356,12 +553,310 @@ protected:
     }
   }
 
+  /*
+    Hilbert R-Tree insertion and deletion; see hilbert_insert.hpp.
+    Entries of every node are in the order of Hilbert values of keys,
+    so the largest Hilbert value of a subtree is that of its last key.
+  */
+
+  static std::uint64_t hilbert_value(key_type const& key)
+  {
+    return insert_algorithm::hilbert_value(key);
+  }
+  // largest Hilbert value of subtree `node` on `level`
+  std::uint64_t hilbert_lhv(node_base_type const* node, int level) const
+  {
+    for (; level < _leaf_level; ++level)
+    {
+      node = node->as_node()->back().second;
+    }
+    leaf_type const* leaf = node->as_leaf();
+    return leaf->empty() ? 0 : hilbert_value(leaf->back().first);
+  }
+
+  // consecutive children of `parent`, up to `count`, including `node`
+  template <typename NodeType>
+  static std::vector<NodeType*>
+  hilbert_siblings(node_type* parent, NodeType* node, size_type count)
+  {
+    count = std::min(count, parent->size());
+    const size_type first
+        = std::min(node->_index_on_parent, parent->size() - count);
+    std::vector<NodeType*> siblings;
+    for (size_type i = first; i < first + count; ++i)
+    {
+      siblings.push_back(static_cast<NodeType*>(parent->at(i).second));
+    }
+    return siblings;
+  }
+
+  // moves every entry of `nodes` to `entries`, in order
+  template <typename NodeType>
+  static void
+  hilbert_collect(std::vector<NodeType*> const& nodes,
+                  std::vector<typename NodeType::value_type>& entries)
+  {
+    for (NodeType* n : nodes)
+    {
+      for (typename NodeType::value_type& c : *n)
+      {
+        entries.emplace_back(std::move(c));
+      }
+      n->clear();
+    }
+  }
+
+  // distributes `entries` evenly over `nodes`, in order
+  template <typename NodeType>
+  void hilbert_distribute(std::vector<typename NodeType::value_type>& entries,
+                          std::vector<NodeType*> const& nodes)
+  {
+    const size_type total = entries.size();
+    size_type e = 0;
+    for (size_type i = 0; i < nodes.size(); ++i)
+    {
+      const size_type end = total * (i + 1) / nodes.size();
+      for (; e < end; ++e)
+      {
+        nodes[i]->insert(std::move(entries[e]));
+      }
+      flat_mark(nodes[i]);
+      flat_mark_children(nodes[i]);
+    }
+    // bounds of `nodes` are stored in their parent
+    for (NodeType* n : nodes)
+    {
+      if (n->parent())
+      {
+        flat_mark(n->parent());
+        n->entry().first = n->calculate_bound();
+      }
+    }
+  }
+
+  // leaf with the smallest LHV not less than `h`, or the last leaf
+  leaf_type* hilbert_choose_leaf(std::uint64_t h)
+  {
+    node_base_type* n = _root;
+    for (int level = 0; level < _leaf_level; ++level)
+    {
+      node_type* node = n->as_node();
+      // LHVs of children are non-decreasing
+      size_type lo = 0;
+      size_type hi = node->size() - 1;
+      while (lo < hi)
+      {
+        const size_type mid = (lo + hi) / 2;
+        if (hilbert_lhv(node->at(mid).second, level + 1) < h)
+        {
+          lo = mid + 1;
+        }
+        else
+        {
+          hi = mid;
+        }
+      }
+      n = node->at(lo).second;
+    }
+    return n->as_leaf();
+  }
+
+  // inserts `child` at `index` of `node`; on overflow, shares entries with
+  // cooperating siblings, or splits them into one more node
+  template <typename NodeType>
+  void hilbert_insert_node(NodeType* node,
+                           size_type index,
+                           typename NodeType::value_type child)
+  {
+    flat_mark(node);
+    if constexpr (std::is_same<NodeType, node_type>::value)
+    {
+      flat_mark(child.second);
+    }
+    if (node->size() < MAX_ENTRIES)
+    {
+      node->insert(index, std::move(child));
+      rebound(node);
+      return;
+    }
+
+    std::vector<NodeType*> siblings;
+    if (node == _root)
+    {
+      siblings.push_back(node);
+    }
+    else
+    {
+      siblings = hilbert_siblings(node->parent(), node,
+                                  insert_algorithm::COOPERATING_SIBLINGS);
+    }
+    std::vector<typename NodeType::value_type> entries;
+    entries.reserve((siblings.size() + 1) * MAX_ENTRIES);
+    for (NodeType* n : siblings)
+    {
+      if (n == node)
+      {
+        index += entries.size();
+      }
+      for (typename NodeType::value_type& c : *n)
+      {
+        entries.emplace_back(std::move(c));
+      }
+      n->clear();
+    }
+    entries.insert(entries.begin() + index, std::move(child));
+
+    // every sibling is full; split into one more node
+    NodeType* pair = nullptr;
+    if (entries.size() > siblings.size() * MAX_ENTRIES)
+    {
+      if constexpr (MODIFY_EVENTS)
+      {
+        notify(modify_event_t::split, height_of(node), entries.size());
+      }
+      pair = construct_node<NodeType>();
+      siblings.push_back(pair);
+    }
+    hilbert_distribute(entries, siblings);
+
+    if (pair == nullptr)
+    {
+      if (node->parent())
+      {
+        rebound(node->parent());
+      }
+      return;
+    }
+    if (node == _root)
+    {
+      node_type* new_root = construct_node<node_type>();
+      new_root->insert({ node->calculate_bound(), node });
+      new_root->insert({ pair->calculate_bound(), pair });
+      _root = new_root;
+      flat_mark(new_root);
+      ++_leaf_level;
+      if constexpr (MODIFY_EVENTS)
+      {
+        notify(modify_event_t::root_grow, _leaf_level, 2);
+      }
+      return;
+    }
+    // new node right after the last sibling
+    node_type* parent = siblings.front()->parent();
+    const size_type last = siblings[siblings.size() - 2]->_index_on_parent;
+    hilbert_insert_node(parent, last + 1, { pair->calculate_bound(), pair });
+  }
+
+  void hilbert_insert(value_type new_val)
+  {
+    const std::uint64_t h = hilbert_value(new_val.first);
+    leaf_type* leaf = hilbert_choose_leaf(h);
+    // after every key of the same Hilbert value
+    size_type lo = 0;
+    size_type hi = leaf->size();
+    while (lo < hi)
+    {
+      const size_type mid = (lo + hi) / 2;
+      if (hilbert_value(leaf->at(mid).first) <= h)
+      {
+        lo = mid + 1;
+      }
+      else
+      {
+        hi = mid;
+      }
+    }
+    hilbert_insert_node(leaf, lo, std::move(new_val));
+  }
+
+  // `node` lost an entry; borrows from cooperating siblings if it is
+  // underfull, or merges them into one less node
+  template <typename NodeType>
+  void hilbert_underflow(NodeType* node)
+  {
+    if (node == _root)
+    {
+      return;
+    }
+    node_type* parent = node->parent();
+    flat_mark(parent);
+    if (node->size() >= MIN_ENTRIES)
+    {
+      rebound(node);
+      return;
+    }
+
+    std::vector<NodeType*> siblings = hilbert_siblings(
+        parent, node,
+        std::max<size_type>(insert_algorithm::COOPERATING_SIBLINGS, 2));
+    std::vector<typename NodeType::value_type> entries;
+    entries.reserve(siblings.size() * MAX_ENTRIES);
+    hilbert_collect(siblings, entries);
+
+    if (entries.size() >= siblings.size() * MIN_ENTRIES)
+    {
+      hilbert_distribute(entries, siblings);
+      rebound(parent);
+      return;
+    }
+
+    // merge into one less node
+    NodeType* removed = siblings.back();
+    siblings.pop_back();
+    EH_RTREE_ASSERT_SILENT(siblings.size() > 0 || entries.empty());
+    hilbert_distribute(entries, siblings);
+    parent->erase_at(removed->_index_on_parent);
+    destroy_node(removed);
+    hilbert_underflow(parent);
+  }
+
+  void hilbert_erase(iterator pos)
+  {
+    leaf_type* leaf = pos._leaf;
+    leaf->erase_at(pos._pointer - leaf->data());
+    flat_mark(leaf);
+    hilbert_underflow(leaf);
+
+    while (_leaf_level > 0 && _root->as_node()->size() == 1)
+    {
+      node_base_type* child = _root->as_node()->at(0).second;
+      _root->as_node()->erase(child);
+      destroy_node(_root->as_node());
+      _root = child;
+      flat_mark(child);
+      --_leaf_level;
+      if constexpr (MODIFY_EVENTS)
+      {
+        notify(modify_event_t::root_shrink, _leaf_level, 1);
+      }
+    }
+  }
+
 public:
   void insert(value_type new_val)
   {
-    leaf_type* chosen
-        = choose_insert_target(new_val.first, _leaf_level)->as_leaf();
-    insert_node(chosen, std::move(new_val), true);
+    ++_epoch;
+    std::uint64_t splits_before = 0;
+    if constexpr (STATS)
+    {
+      splits_before = thread_modify_stats().total_splits();
+    }
+    if constexpr (HILBERT_INSERT)
+    {
+      hilbert_insert(std::move(new_val));
+    }
+    else
+    {
+      leaf_type* chosen
+          = choose_insert_target(new_val.first, _leaf_level)->as_leaf();
+      insert_node(chosen, std::move(new_val), true);
+    }
+    if constexpr (STATS)
+    {
+      modify_stats& stats = thread_modify_stats();
+      stats.max_split_cascade = std::max(stats.max_split_cascade,
+                                         stats.total_splits() - splits_before);
+    }
   }
   template <typename... Args>
   void emplace(Args&&... args)
@@ -371,8 +866,15 @@ public:
 
   void erase(iterator pos)
   {
+    ++_epoch;
+    if constexpr (HILBERT_INSERT)
+    {
+      hilbert_erase(pos);
+      return;
+    }
     leaf_type* leaf = pos._leaf;
     leaf->erase(pos._pointer);
+    flat_mark(leaf);
 
     if (leaf == _root)
     {
@@ -388,6 +890,7 @@ public:
     std::vector<erase_reinsert_node_info_t> reinsert_nodes;
 
     node_type* node = leaf->parent();
+    flat_mark(node);
     if (leaf->size() < MIN_ENTRIES)
     {
       // delete node from node's parent
@@ -403,6 +906,7 @@ public:
     for (int level = _leaf_level - 1; level > 0; --level)
     {
       node_type* parent = node->parent();
+      flat_mark(parent);
       if (node->size() < MIN_ENTRIES)
       {
         // delete node from node's parent
@@ -426,7 +930,12 @@ public:
         _root->as_node()->erase(child);
         destroy_node(_root->as_node());
         _root = child;
+        flat_mark(child);
         --_leaf_level;
+        if constexpr (MODIFY_EVENTS)
+        {
+          notify(modify_event_t::root_shrink, _leaf_level, 1);
+        }
       }
     }
 
@@ -434,6 +943,14 @@ public:
     // sustain the relative level from leaf
     for (erase_reinsert_node_info_t reinsert : reinsert_nodes)
     {
+      if constexpr (MODIFY_EVENTS)
+      {
+        notify(modify_event_t::erase_reinsert,
+               reinsert.relative_level_from_leaf,
+               reinsert.relative_level_from_leaf == 0
+                   ? reinsert.parent->as_leaf()->size()
+                   : reinsert.parent->as_node()->size());
+      }
       // leaf node
       if (reinsert.relative_level_from_leaf == 0)
       {
@@ -467,6 +984,10 @@ public:
       return _root->as_node()->size_recursive(_leaf_level);
     }
   }
+  bool empty() const
+  {
+    return _leaf_level == 0 && _root->as_leaf()->empty();
+  }
 
   void clear()
   {
@@ -478,8 +999,10 @@ public:
   // adjust bound from node `N` to root recursively
   void rebound(node_type* N)
   {
+    ++_epoch;
     while (N->parent())
     {
+      flat_mark(N->parent());
       N->entry().first = N->calculate_bound();
       N = N->parent();
     }
@@ -487,13 +1010,18 @@ public:
   // adjust bound from node `leaf` to root recursively
   void rebound(leaf_type* leaf)
   {
+    ++_epoch;
+    flat_mark(leaf);
     if (leaf->parent())
     {
+      flat_mark(leaf->parent());
       leaf->entry().first = leaf->calculate_bound();
       rebound(leaf->parent());
     }
   }
-  // adjust bound from the iterator to root recursively
+  // adjust bound from the iterator to root recursively;
+  // with `Config::insert_algorithm`, a key edited in place breaks the
+  // Hilbert order; erase and insert it instead
   void rebound(iterator pos)
   {
     rebound(pos._leaf);
@@ -561,6 +1089,7 @@ public:
   RTree& operator=(RTree const& rhs)
   {
     delete_if();
+    ++_epoch;
     if (rhs._leaf_level == 0)
     {
       _root = rhs._root->as_leaf()->clone_recursive(*this);
@@ -583,6 +1112,7 @@ public:
   RTree& operator=(RTree&& rhs)
   {
     delete_if();
+    ++_epoch;
     _root = rhs._root;
     _leaf_level = rhs._leaf_level;
     rhs.set_null();
@@ -803,6 +1333,12 @@ public:
     return _leaf_level;
   }
 
+  /// modification epoch; increased whenever the tree is modified
+  std::uint64_t epoch() const
+  {
+    return _epoch;
+  }
+
   node_allocator_type& node_allocator()
   {
     return _node_allocator;
@@ -828,27 +1364,19 @@ public:
   }
   void destroy_node(node_type* node)
   {
+    flat_forget(node);
     node->~node_type();
     node_allocator_type().deallocate(node, 1);
   }
   void destroy_node(leaf_type* node)
   {
+    flat_forget(node);
     node->~leaf_type();
     leaf_allocator_type().deallocate(node, 1);
   }
 
 public:
-  struct flatten_node_t
-  {
-    /// offset in global dense buffer
-    size_type offset;
-
-    /// the number of children
-    size_type size;
-
-    /// parent node index
-    size_type parent;
-  };
+  using flatten_node_t = flat_node_t;
   struct flatten_result_t
   {
     /// leaf node's level
@@ -857,6 +1385,12 @@ public:
     /// root node index; must be 0
     size_type root;
 
+    /// order of `nodes`
+    flatten_layout_t layout = flatten_layout_t::preorder;
+
+    /// tracking generation of `flatten_update()`; 0 if not tracked
+    std::uint64_t generation = 0;
+
     /// node data ( include leaf nodes )
     std::vector<flatten_node_t> nodes;
 
@@ -870,117 +1404,1102 @@ public:
   };
 
 protected:
-  size_type
-  flatten_recursive_leaf(flatten_result_t& res,
-                         leaf_type const* node,
-                         size_type parent_index,
-                         std::integral_constant<bool, true> move_data) const
+  // exact sizes of a subtree in the flattened buffers
+  struct flatten_count_t
   {
-    const size_type this_index = res.nodes.size();
-    res.nodes.emplace_back();
-    res.nodes[this_index].parent = parent_index;
-    res.nodes[this_index].offset = res.children.size();
-    res.nodes[this_index].size = node->size();
+    size_type nodes;
+    size_type slots;
+    size_type entries;
+  };
+
+  // subtrees with fewer entries are flattened on the calling thread
+  constexpr static size_type FLATTEN_PARALLEL_THRESHOLD = 1 << 15;
 
-    for (size_type child_index = 0; child_index < node->size(); ++child_index)
+  // counts of every subtree, indexed by preorder index of its root
+  flatten_count_t
+  flatten_count_recursive(std::vector<flatten_count_t>& counts,
+                          node_type const* node,
+                          int level) const
+  {
+    const size_type this_index = counts.size();
+    counts.emplace_back();
+    flatten_count_t count;
+    count.nodes = 1;
+    if (level == leaf_level())
     {
-      res.children.push_back(0);
-      res.children_bound.push_back(node->at(child_index).first);
+      count.slots = node->as_leaf()->size();
+      count.entries = count.slots;
     }
-
-    for (size_type child_index = 0; child_index < node->size(); ++child_index)
+    else
     {
-      const size_type data_index = res.data.size();
-      res.data.emplace_back(std::move(node->at(child_index).second));
-      res.children[res.nodes[this_index].offset + child_index] = data_index;
+      count.slots = node->size();
+      count.entries = 0;
+      for (auto const& child : *node)
+      {
+        const flatten_count_t c
+            = flatten_count_recursive(counts, child.second->as_node(),
+                                      level + 1);
+        count.nodes += c.nodes;
+        count.slots += c.slots;
+        count.entries += c.entries;
+      }
     }
-    return this_index;
+    counts[this_index] = count;
+    return count;
   }
 
-  size_type
-  flatten_recursive_leaf(flatten_result_t& res,
-                         leaf_type const* node,
-                         size_type parent_index,
-                         std::integral_constant<bool, false> move_data) const
-  {
-    const size_type this_index = res.nodes.size();
-    res.nodes.emplace_back();
-    res.nodes[this_index].parent = parent_index;
-    res.nodes[this_index].offset = res.children.size();
-    res.nodes[this_index].size = node->size();
+  // mapped_type can neither be default constructed nor copied;
+  // data are appended in order on a single thread instead of being sized
+  constexpr static bool FLATTEN_APPEND_DATA
+      = !std::is_default_constructible<mapped_type>::value
+        && !std::is_copy_constructible<mapped_type>::value;
 
-    for (size_type child_index = 0; child_index < node->size(); ++child_index)
+  // stores `value` to res.data[index]
+  template <bool Move>
+  static void flatten_store(flatten_result_t& res,
+                            size_type index,
+                            mapped_type const& value)
+  {
+    if constexpr (FLATTEN_APPEND_DATA)
+    {
+      static_assert(Move, "mapped_type is not copyable; use flatten_move");
+      EH_RTREE_ASSERT_SILENT(index == res.data.size());
+      res.data.push_back(std::move(const_cast<mapped_type&>(value)));
+    }
+    else if constexpr (Move)
+    {
+      res.data[index] = std::move(const_cast<mapped_type&>(value));
+    }
+    else
     {
-      res.children.push_back(0);
-      res.children_bound.push_back(node->at(child_index).first);
+      res.data[index] = value;
     }
+  }
 
-    for (size_type child_index = 0; child_index < node->size(); ++child_index)
+  // resize without requiring default constructor
+  template <typename T>
+  static void flatten_resize(std::vector<T>& v, size_type n, T const& sample)
+  {
+    if constexpr (std::is_default_constructible<T>::value)
+    {
+      v.resize(n);
+    }
+    else
     {
-      const size_type data_index = res.data.size();
-      res.data.emplace_back(node->at(child_index).second);
-      res.children[res.nodes[this_index].offset + child_index] = data_index;
+      v.resize(n, sample);
     }
-    return this_index;
   }
 
-  template <bool Move = false>
-  size_type flatten_recursive(flatten_result_t& res,
+  // fills the subtree of `node` into preallocated buffers;
+  // the node goes to nodes[this_index], its children to [slot, slot+size),
+  // its leaf values to data[data, ...).
+  // same offsets as depth-first preorder emission.
+  // children are distributed over at most `threads` threads
+  template <bool Move>
+  void flatten_fill_recursive(flatten_result_t& res,
+                              std::vector<flatten_count_t> const& counts,
                               node_type const* node,
+                              size_type this_index,
                               size_type parent_index,
-                              int level) const
+                              size_type slot,
+                              size_type data,
+                              int level,
+                              unsigned int threads) const
   {
+    flatten_node_t& this_node = res.nodes[this_index];
+    this_node.parent = parent_index;
+    this_node.offset = slot;
+
     if (level == leaf_level())
     {
-      return flatten_recursive_leaf(res, node->as_leaf(), parent_index,
-                                    std::integral_constant<bool, Move> {});
+      leaf_type const* leaf = node->as_leaf();
+      this_node.size = leaf->size();
+      for (size_type i = 0; i < leaf->size(); ++i)
+      {
+        res.children_bound[slot + i] = leaf->at(i).first;
+        res.children[slot + i] = data + i;
+        flatten_store<Move>(res, data + i, leaf->at(i).second);
+      }
+      return;
     }
-    else
-    {
-      // add this node to buffer
-      const size_type this_index = res.nodes.size();
-      res.nodes.emplace_back();
-      res.nodes[this_index].parent = parent_index;
-      res.nodes[this_index].offset = res.children.size();
-      res.nodes[this_index].size = node->size();
 
-      for (size_type child_index = 0; child_index < node->size(); ++child_index)
+    this_node.size = node->size();
+    if (counts[this_index].entries < FLATTEN_PARALLEL_THRESHOLD)
+    {
+      threads = 1;
+    }
+    // children [ group*i, group*(i+1) ) are filled by i-th thread,
+    // the last group on this thread
+    const size_type t = std::min<size_type>(threads, node->size());
+    const size_type group = (node->size() + t - 1) / t;
+    const size_type group_count = (node->size() + group - 1) / group;
+    const unsigned int child_threads
+        = std::max<unsigned int>(threads / group_count, 1);
+
+    std::vector<std::thread> workers;
+    size_type child_index = this_index + 1;
+    size_type child_slot = slot + node->size();
+    size_type child_data = data;
+    for (size_type begin = 0; begin < node->size(); begin += group)
+    {
+      const size_type end = std::min(begin + group, node->size());
+      auto work = [&res, &counts, node, this_index, child_index, child_slot,
+                   child_data, begin, end, level, child_threads, this]()
+      {
+        size_type index = child_index;
+        size_type s = child_slot;
+        size_type d = child_data;
+        for (size_type i = begin; i < end; ++i)
+        {
+          flatten_fill_recursive<Move>(res, counts,
+                                       node->at(i).second->as_node(), index,
+                                       this_index, s, d, level + 1,
+                                       child_threads);
+          s += counts[index].slots;
+          d += counts[index].entries;
+          index += counts[index].nodes;
+        }
+      };
+      for (size_type i = begin; i < end; ++i)
       {
-        res.children.push_back(0);
-        res.children_bound.push_back(node->at(child_index).first);
+        res.children_bound[slot + i] = node->at(i).first;
+        res.children[slot + i] = child_index;
+        child_slot += counts[child_index].slots;
+        child_data += counts[child_index].entries;
+        child_index += counts[child_index].nodes;
       }
-
-      for (size_type child_index = 0; child_index < node->size(); ++child_index)
+      if (end < node->size())
+      {
+        workers.emplace_back(work);
+      }
+      else
       {
-        res.children[res.nodes[this_index].offset + child_index]
-            = flatten_recursive<Move>(res,
-                                      node->at(child_index).second->as_node(),
-                                      this_index, level + 1);
+        work();
       }
-      return this_index;
+    }
+    for (std::thread& worker : workers)
+    {
+      worker.join();
     }
   }
 
-public:
-  /// flatten the tree into a single dense buffer
-  template <bool Move = false>
-  flatten_result_t flatten() const
+  // sizes every buffer of `res` once
+  void flatten_allocate(flatten_result_t& res,
+                        flatten_count_t const& total) const
   {
-    flatten_result_t res;
-    res.leaf_level = leaf_level();
-    res.root = 0;
-    flatten_recursive<Move>(res, root(), 0, 0);
-    return res;
+    res.nodes.resize(total.nodes);
+    res.children.resize(total.slots);
+    if (total.entries > 0)
+    {
+      // any value in the tree as a sample for non-default-constructible types
+      node_type const* node = root();
+      for (int level = 0; level < leaf_level(); ++level)
+      {
+        node = node->at(0).second->as_node();
+      }
+      leaf_type const* leaf = node->as_leaf();
+      flatten_resize(res.children_bound, total.slots,
+                     geometry_type(leaf->at(0).first));
+      if constexpr (FLATTEN_APPEND_DATA)
+      {
+        res.data.reserve(total.entries);
+      }
+      else
+      {
+        flatten_resize(res.data, total.entries, leaf->at(0).second);
+      }
+    }
+  }
+
+  // node and its level, in the order of flattened `nodes`
+  struct flatten_order_t
+  {
+    node_type const* node;
+    int level;
+  };
+
+  // depth-first preorder; leaves are skipped if `skip_leaves`
+  void flatten_collect_preorder(std::vector<flatten_order_t>& order,
+                                node_type const* node,
+                                int level,
+                                bool skip_leaves) const
+  {
+    if (level == leaf_level())
+    {
+      if (!skip_leaves)
+      {
+        order.push_back({ node, level });
+      }
+      return;
+    }
+    order.push_back({ node, level });
+    for (auto const& child : *node)
+    {
+      flatten_collect_preorder(order, child.second->as_node(), level + 1,
+                               skip_leaves);
+    }
+  }
+
+  // nodes on `target_level` under `node`, from left to right
+  void flatten_collect_level(std::vector<flatten_order_t>& out,
+                             node_type const* node,
+                             int level,
+                             int target_level) const
+  {
+    if (level == target_level)
+    {
+      out.push_back({ node, level });
+      return;
+    }
+    for (auto const& child : *node)
+    {
+      flatten_collect_level(out, child.second->as_node(), level + 1,
+                            target_level);
+    }
+  }
+
+  // van Emde Boas order of the subtree of `height` levels under `node`;
+  // the top half of the levels first, then every bottom subtree
+  void flatten_collect_veb(std::vector<flatten_order_t>& order,
+                           node_type const* node,
+                           int level,
+                           int height) const
+  {
+    if (height == 1)
+    {
+      order.push_back({ node, level });
+      return;
+    }
+    const int top = height / 2;
+    flatten_collect_veb(order, node, level, top);
+    std::vector<flatten_order_t> bottom;
+    flatten_collect_level(bottom, node, level, level + top);
+    for (flatten_order_t const& b : bottom)
+    {
+      flatten_collect_veb(order, b.node, b.level, height - top);
+    }
+  }
+
+  // fills every node of `order` to nodes[i];
+  // children slots and values follow the same order.
+  // nodes are partitioned over `threads` threads
+  template <bool Move>
+  void flatten_fill_ordered(flatten_result_t& res,
+                            std::vector<flatten_order_t> const& order,
+                            unsigned int threads) const
+  {
+    std::unordered_map<node_type const*, size_type> index_of;
+    index_of.reserve(order.size());
+    std::vector<size_type> slot(order.size());
+    std::vector<size_type> data(order.size());
+    flatten_count_t total = { size_type(order.size()), 0, 0 };
+    for (size_type i = 0; i < order.size(); ++i)
+    {
+      index_of[order[i].node] = i;
+      slot[i] = total.slots;
+      data[i] = total.entries;
+      const size_type size = order[i].level == leaf_level()
+                                 ? order[i].node->as_leaf()->size()
+                                 : order[i].node->size();
+      total.slots += size;
+      if (order[i].level == leaf_level())
+      {
+        total.entries += size;
+      }
+    }
+    flatten_allocate(res, total);
+    res.nodes[0].parent = 0;
+
+    auto work = [&](size_type begin, size_type end)
+    {
+      for (size_type i = begin; i < end; ++i)
+      {
+        flatten_node_t& this_node = res.nodes[i];
+        this_node.offset = slot[i];
+        if (order[i].level == leaf_level())
+        {
+          leaf_type const* leaf = order[i].node->as_leaf();
+          this_node.size = leaf->size();
+          for (size_type c = 0; c < leaf->size(); ++c)
+          {
+            res.children_bound[slot[i] + c] = leaf->at(c).first;
+            res.children[slot[i] + c] = data[i] + c;
+            flatten_store<Move>(res, data[i] + c, leaf->at(c).second);
+          }
+          continue;
+        }
+        node_type const* node = order[i].node;
+        this_node.size = node->size();
+        for (size_type c = 0; c < node->size(); ++c)
+        {
+          const size_type child
+              = index_of.find(node->at(c).second->as_node())->second;
+          res.children_bound[slot[i] + c] = node->at(c).first;
+          res.children[slot[i] + c] = child;
+          res.nodes[child].parent = i;
+        }
+      }
+    };
+
+    const size_type count = order.size();
+    if (total.entries < FLATTEN_PARALLEL_THRESHOLD)
+    {
+      threads = 1;
+    }
+    threads = std::min<size_type>(threads, count);
+    const size_type chunk = (count + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (size_type t = 1; t < threads; ++t)
+    {
+      workers.emplace_back(work, std::min(count, t * chunk),
+                           std::min(count, (t + 1) * chunk));
+    }
+    work(0, std::min(count, chunk));
+    for (std::thread& worker : workers)
+    {
+      worker.join();
+    }
+  }
+
+public:
+  /// flatten the tree into a single dense buffer, in depth-first preorder.
+  /// sizes of every buffer are computed first and filled once;
+  /// large subtrees are filled in parallel by up to `threads` threads
+  /// ( 0 for std::thread::hardware_concurrency() ).
+  /// the result does not depend on `threads`
+  template <bool Move = false>
+  flatten_result_t flatten(unsigned int threads = 0) const
+  {
+    return flatten<Move>(flatten_layout_t::preorder, threads);
+  }
+
+  /// flatten the tree into a single dense buffer, with nodes in `layout`
+  /// order. see `flatten_layout_t`
+  template <bool Move = false>
+  flatten_result_t flatten(flatten_layout_t layout,
+                           unsigned int threads = 0) const
+  {
+    flatten_result_t res;
+    if (layout == flatten_layout_t::unordered)
+    {
+      layout = flatten_layout_t::preorder;
+    }
+    res.leaf_level = leaf_level();
+    res.root = 0;
+    res.layout = layout;
+    if (threads == 0)
+    {
+      threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    if constexpr (FLATTEN_APPEND_DATA)
+    {
+      threads = 1;
+    }
+
+    if (layout == flatten_layout_t::preorder)
+    {
+      std::vector<flatten_count_t> counts;
+      flatten_allocate(res, flatten_count_recursive(counts, root(), 0));
+      flatten_fill_recursive<Move>(res, counts, root(), 0, 0, 0, 0, 0,
+                                   threads);
+      return res;
+    }
+
+    std::vector<flatten_order_t> order;
+    switch (layout)
+    {
+    case flatten_layout_t::breadth_first:
+      for (int level = 0; level <= leaf_level(); ++level)
+      {
+        flatten_collect_level(order, root(), 0, level);
+      }
+      break;
+    case flatten_layout_t::van_emde_boas:
+      flatten_collect_veb(order, root(), 0, leaf_level() + 1);
+      break;
+    case flatten_layout_t::leaves_last:
+      flatten_collect_preorder(order, root(), 0, true);
+      flatten_collect_level(order, root(), 0, leaf_level());
+      break;
+    default:
+      break;
+    }
+    flatten_fill_ordered<Move>(res, order, threads);
+    return res;
   }
 
   /// flatten the tree into a single dense buffer;
   /// move the data
-  flatten_result_t flatten_move() const
+  flatten_result_t flatten_move(unsigned int threads = 0) const
+  {
+    return flatten<true>(threads);
+  }
+  /// flatten the tree into a single dense buffer with nodes in `layout`
+  /// order; move the data
+  flatten_result_t flatten_move(flatten_layout_t layout,
+                                unsigned int threads = 0) const
+  {
+    return flatten<true>(layout, threads);
+  }
+
+protected:
+  // rebuilds the subtree of flat.nodes[index]; moves the data
+  template <typename KeyConverter>
+  node_base_type* from_flat_recursive(flatten_result_t& flat,
+                                      size_type index,
+                                      int level,
+                                      KeyConverter& to_key)
+  {
+    flatten_node_t const& n = flat.nodes[index];
+    EH_RTREE_ASSERT(n.size <= MAX_ENTRIES, "flattened node is too large");
+    if (level == int(flat.leaf_level))
+    {
+      leaf_type* leaf = construct_node<leaf_type>();
+      for (size_type i = n.offset; i < n.offset + n.size; ++i)
+      {
+        leaf->insert(value_type(to_key(flat.children_bound[i]),
+                                std::move(flat.data[flat.children[i]])));
+      }
+      return leaf;
+    }
+    node_type* node = construct_node<node_type>();
+    for (size_type i = n.offset; i < n.offset + n.size; ++i)
+    {
+      node->insert(
+          { flat.children_bound[i],
+            from_flat_recursive(flat, flat.children[i], level + 1, to_key) });
+    }
+    return node;
+  }
+
+public:
+  /// rebuilds the tree structure of `flat` in O(n), in any layout;
+  /// same nodes and bounds as the flattened tree, data are moved.
+  /// `to_key(geometry_type const&)` converts a stored bound of value
+  /// back to `key_type`
+  template <typename KeyConverter>
+  static RTree from_flat(flatten_result_t&& flat, KeyConverter&& to_key)
+  {
+    RTree ret;
+    if (flat.nodes.empty())
+    {
+      return ret;
+    }
+    ret.delete_if();
+    ret.set_null();
+    ret._root = ret.from_flat_recursive(flat, flat.root, 0, to_key);
+    ret._leaf_level = flat.leaf_level;
+    if constexpr (HILBERT_INSERT)
+    {
+      ret.hilbert_restore();
+    }
+    return ret;
+  }
+  /// rebuilds the tree structure of `flat` in O(n);
+  /// `key_type` must be constructible from `geometry_type`
+  static RTree from_flat(flatten_result_t&& flat)
+  {
+    return from_flat(std::move(flat),
+                     [](geometry_type const& bound)
+                     { return key_type(bound); });
+  }
+
+protected:
+  // merges groups smaller than MIN_ENTRIES into their neighbour,
+  // splitting merged groups larger than MAX_ENTRIES in half
+  static void bulk_fix_groups(std::vector<size_type>& groups)
+  {
+    std::vector<size_type> fixed;
+    fixed.reserve(groups.size());
+    for (size_type g : groups)
+    {
+      EH_RTREE_ASSERT(g > 0 && g <= MAX_ENTRIES,
+                      "bulk load strategy made an invalid group");
+      if (fixed.empty() || (g >= MIN_ENTRIES && fixed.back() >= MIN_ENTRIES))
+      {
+        fixed.push_back(g);
+        continue;
+      }
+      const size_type total = fixed.back() + g;
+      if (total > MAX_ENTRIES)
+      {
+        fixed.back() = total / 2;
+        fixed.push_back(total - total / 2);
+      }
+      else
+      {
+        fixed.back() = total;
+      }
+    }
+    groups = std::move(fixed);
+  }
+
+public:
+  /// replaces the contents with the values in [first, last),
+  /// building the tree bottom-up by `Strategy` instead of `insert()`.
+  /// see bulk_load.hpp; `HilbertBulkLoad` packs nodes along the Hilbert
+  /// curve, `PRTreeBulkLoad` builds a Priority R-Tree.
+  /// with `Config::insert_algorithm`, `Strategy` is ignored and values are
+  /// packed in the order of `insert_algorithm::hilbert_value()`
+  template <typename Strategy = HilbertBulkLoad, typename Iterator>
+  void bulk_load(Iterator first, Iterator last)
+  {
+    // collected first; [first, last) may refer to values of this tree
+    std::vector<value_type> values(first, last);
+    if constexpr (HILBERT_INSERT)
+    {
+      hilbert_sort(values);
+      bulk_build<SequentialBulkLoad>(values);
+    }
+    else
+    {
+      bulk_build<Strategy>(values);
+    }
+  }
+
+protected:
+  // sorts `values` by `hilbert_value()` of their keys
+  static void hilbert_sort(std::vector<value_type>& values)
+  {
+    std::vector<std::pair<std::uint64_t, size_type>> curve;
+    curve.reserve(values.size());
+    for (size_type i = 0; i < values.size(); ++i)
+    {
+      curve.emplace_back(hilbert_value(values[i].first), i);
+    }
+    std::sort(curve.begin(), curve.end());
+    std::vector<value_type> sorted;
+    sorted.reserve(values.size());
+    for (auto const& c : curve)
+    {
+      sorted.push_back(std::move(values[c.second]));
+    }
+    values = std::move(sorted);
+  }
+
+  // true if values are stored in the order of `hilbert_value()`,
+  // as `hilbert_choose_leaf()` assumes
+  bool hilbert_ordered() const
+  {
+    std::uint64_t prev = 0;
+    for (value_type const& v : *this)
+    {
+      const std::uint64_t h = hilbert_value(v.first);
+      if (h < prev)
+      {
+        return false;
+      }
+      prev = h;
+    }
+    return true;
+  }
+
+  // repacks the tree in the order of `hilbert_value()` unless it already is;
+  // for structures built by other means, e.g. `load()` or `from_flat()`
+  void hilbert_restore()
+  {
+    if (hilbert_ordered())
+    {
+      return;
+    }
+    std::vector<value_type> values;
+    values.reserve(size());
+    for (value_type& v : *this)
+    {
+      values.push_back(std::move(v));
+    }
+    hilbert_sort(values);
+    bulk_build<SequentialBulkLoad>(values);
+  }
+
+  // replaces the contents with `values`, packed by `Strategy`
+  template <typename Strategy>
+  void bulk_build(std::vector<value_type>& values)
+  {
+    delete_if();
+    set_null();
+    if (values.empty())
+    {
+      init_root();
+      return;
+    }
+
+    std::vector<geometry_type> bounds;
+    bounds.reserve(values.size());
+    for (value_type const& v : values)
+    {
+      bounds.push_back(geometry_type(v.first));
+    }
+    std::vector<size_type> order;
+    std::vector<size_type> groups;
+    Strategy::partition(bounds, MAX_ENTRIES, order, groups);
+    EH_RTREE_ASSERT(order.size() == values.size(),
+                    "bulk load strategy lost values");
+    bulk_fix_groups(groups);
+
+    std::vector<node_base_type*> nodes;
+    std::vector<geometry_type> node_bounds;
+    size_type o = 0;
+    for (size_type g : groups)
+    {
+      leaf_type* leaf = construct_node<leaf_type>();
+      for (size_type i = 0; i < g; ++i, ++o)
+      {
+        leaf->insert(std::move(values[order[o]]));
+      }
+      nodes.push_back(leaf);
+      node_bounds.push_back(leaf->calculate_bound());
+    }
+
+    int levels = 0;
+    while (nodes.size() > 1)
+    {
+      order.clear();
+      groups.clear();
+      Strategy::partition(node_bounds, MAX_ENTRIES, order, groups);
+      bulk_fix_groups(groups);
+      std::vector<node_base_type*> parents;
+      std::vector<geometry_type> parent_bounds;
+      o = 0;
+      for (size_type g : groups)
+      {
+        node_type* node = construct_node<node_type>();
+        for (size_type i = 0; i < g; ++i, ++o)
+        {
+          node->insert({ node_bounds[order[o]], nodes[order[o]] });
+        }
+        parents.push_back(node);
+        parent_bounds.push_back(node->calculate_bound());
+      }
+      nodes = std::move(parents);
+      node_bounds = std::move(parent_bounds);
+      ++levels;
+    }
+    _root = nodes[0];
+    _leaf_level = levels;
+  }
+
+  template <typename Serializer>
+  void save_recursive(std::ostream& os,
+                      node_base_type const* node,
+                      int level,
+                      Serializer const& serializer) const
+  {
+    if (level == leaf_level())
+    {
+      leaf_type const* leaf = node->as_leaf();
+      helper::write_raw(os, std::uint32_t(leaf->size()));
+      for (value_type const& c : *leaf)
+      {
+        helper::write_raw(os, c.first);
+        serializer.write(os, c.second);
+      }
+      return;
+    }
+    node_type const* n = node->as_node();
+    helper::write_raw(os, std::uint32_t(n->size()));
+    for (auto const& c : *n)
+    {
+      helper::write_raw(os, c.first);
+      save_recursive(os, c.second, level + 1, serializer);
+    }
+  }
+
+  // reads a node record; nullptr on failure, with nothing allocated
+  template <typename Serializer>
+  node_base_type* load_recursive(std::istream& is,
+                                 int level,
+                                 int tree_leaf_level,
+                                 std::uint64_t& count,
+                                 Serializer const& serializer)
+  {
+    // only a root leaf may be empty, and a non-leaf root has at least
+    // 2 children
+    std::uint32_t size;
+    if (!helper::read_raw(is, size) || size > MAX_ENTRIES
+        || (size == 0 && (level > 0 || level != tree_leaf_level))
+        || (size < 2 && level == 0 && level != tree_leaf_level))
+    {
+      return nullptr;
+    }
+    if (level == tree_leaf_level)
+    {
+      leaf_type* leaf = construct_node<leaf_type>();
+      helper::raw_value_t<key_type> key;
+      mapped_type mapped;
+      for (std::uint32_t i = 0; i < size; ++i)
+      {
+        if (!key.read(is) || !serializer.read(is, mapped))
+        {
+          destroy_node(leaf);
+          return nullptr;
+        }
+        leaf->insert(value_type(key.get(), std::move(mapped)));
+      }
+      count += size;
+      return leaf;
+    }
+    node_type* node = construct_node<node_type>();
+    helper::raw_value_t<geometry_type> bound;
+    for (std::uint32_t i = 0; i < size; ++i)
+    {
+      node_base_type* child = nullptr;
+      if (bound.read(is))
+      {
+        child = load_recursive(is, level + 1, tree_leaf_level, count,
+                               serializer);
+      }
+      if (child == nullptr)
+      {
+        node->delete_recursive(tree_leaf_level - level, *this);
+        destroy_node(node);
+        return nullptr;
+      }
+      node->insert({ bound.get(), child });
+    }
+    return node;
+  }
+
+public:
+  /// writes the tree structure to `os`, depth-first;
+  /// `serializer` writes `mapped_type`. see serialize.hpp.
+  /// returns false on I/O failure
+  template <typename Serializer = RawSerializer>
+  bool save(std::ostream& os, Serializer const& serializer = Serializer()) const
+  {
+    tree_file_header_t h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, "EHRTTREE", 8);
+    h.version = TREE_FILE_VERSION;
+    h.endian = TREE_FILE_ENDIAN;
+    h.dimension = geometry_traits<geometry_type>::DIM;
+    h.leaf_level = leaf_level();
+    h.geometry_size = sizeof(geometry_type);
+    h.key_size = sizeof(key_type);
+    h.mapped_size = sizeof(mapped_type);
+    h.size = size();
+    helper::write_raw(os, h);
+    save_recursive(os, root(), 0, serializer);
+    return bool(os);
+  }
+
+  /// replaces the tree with the one written by `save()`;
+  /// nodes are rebuilt as stored, without reinsertion.
+  /// `serializer` reads `mapped_type`, which must be default constructible.
+  /// returns false on malformed stream, and the tree is left empty
+  template <typename Serializer = RawSerializer>
+  bool load(std::istream& is, Serializer const& serializer = Serializer())
   {
-    return flatten<true>();
+    clear();
+    tree_file_header_t h;
+    if (!helper::read_raw(is, h) || std::memcmp(h.magic, "EHRTTREE", 8) != 0
+        || h.version != TREE_FILE_VERSION || h.endian != TREE_FILE_ENDIAN
+        || h.dimension != std::uint32_t(geometry_traits<geometry_type>::DIM)
+        || h.geometry_size != sizeof(geometry_type)
+        || h.key_size != sizeof(key_type)
+        || h.mapped_size != sizeof(mapped_type) || h.leaf_level > 64)
+    {
+      return false;
+    }
+    std::uint64_t count = 0;
+    node_base_type* root
+        = load_recursive(is, 0, int(h.leaf_level), count, serializer);
+    if (root == nullptr)
+    {
+      return false;
+    }
+    delete_if();
+    set_null();
+    _root = root;
+    _leaf_level = h.leaf_level;
+    if (count != h.size)
+    {
+      clear();
+      return false;
+    }
+    if constexpr (HILBERT_INSERT)
+    {
+      hilbert_restore();
+    }
+    return true;
+  }
+
+protected:
+  // starts tracking changes against `flat`, a fresh preorder flatten
+  void flat_track(flatten_result_t& flat)
+  {
+    static std::atomic<std::uint64_t> generations { 0 };
+    flat_tracker_t& t = _flat_tracker;
+    t = flat_tracker_t();
+    t.active = true;
+    t.generation = ++generations;
+    flat.generation = t.generation;
+    t.live_slots = flat.children.size();
+
+    std::vector<flatten_order_t> order;
+    flatten_collect_preorder(order, root(), 0, false);
+    t.nodes.reserve(order.size());
+    t.regions.reserve(order.size());
+    t.index.reserve(order.size());
+    for (size_type i = 0; i < order.size(); ++i)
+    {
+      flatten_node_t const& n = flat.nodes[i];
+      const bool leaf = order[i].level == leaf_level();
+      t.nodes.push_back(order[i].node);
+      t.regions.push_back({ n.offset, n.size,
+                            leaf && n.size > 0 ? flat.children[n.offset] : 0,
+                            leaf ? n.size : 0, n.size });
+      t.index.emplace(order[i].node, i);
+    }
+  }
+
+public:
+  /// result of `flatten_update()`
+  struct flatten_update_result_t
+  {
+    /// true if the buffers were rebuilt by `flatten()`
+    bool full = false;
+    /// modified byte ranges of each buffer, sorted and merged;
+    /// buffers may have grown
+    std::vector<flatten_range_t> ranges;
+  };
+
+  /// brings `flat` up to date with the tree, rewriting only the records of
+  /// nodes changed since the last call and appending new ones.
+  /// the first call, or a call with a buffer not produced by the last call,
+  /// rebuilds it with `flatten()`; so does a call when more than half of
+  /// the buffers became unreachable.
+  /// once a record is appended or moved, `flat.layout` becomes
+  /// `flatten_layout_t::unordered` until the next rebuild.
+  /// values changed through iterators are tracked only after `rebound()`
+  flatten_update_result_t flatten_update(flatten_result_t& flat)
+  {
+    flatten_update_result_t result;
+    flat_tracker_t& t = _flat_tracker;
+    auto add_range = [&](flatten_buffer_t buffer, std::size_t element_size,
+                         std::size_t first, std::size_t count)
+    {
+      if (count > 0)
+      {
+        result.ranges.push_back(
+            { buffer, first * element_size, count * element_size });
+      }
+    };
+
+    if (!t.active || flat.generation != t.generation
+        || flat.nodes.size() > 2 * t.index.size()
+        || flat.children.size() > 2 * t.live_slots + MAX_ENTRIES)
+    {
+      flat = flatten();
+      flat_track(flat);
+      result.full = true;
+      add_range(flatten_buffer_t::nodes, sizeof(flatten_node_t), 0,
+                flat.nodes.size());
+      add_range(flatten_buffer_t::children_bound, sizeof(geometry_type), 0,
+                flat.children_bound.size());
+      add_range(flatten_buffer_t::children, sizeof(size_type), 0,
+                flat.children.size());
+      add_range(flatten_buffer_t::data, sizeof(mapped_type), 0,
+                flat.data.size());
+      return result;
+    }
+
+    std::vector<node_base_type const*> work(t.dirty.begin(), t.dirty.end());
+    t.dirty.clear();
+    auto is_leaf = [&](node_base_type const* node)
+    { return node->level_recursive() == leaf_level(); };
+    // children and parent must be rewritten after the index of `node` moved
+    auto push_neighbours = [&](node_base_type const* node)
+    {
+      if (node->parent())
+      {
+        work.push_back(node->parent());
+      }
+      if (!is_leaf(node))
+      {
+        for (auto const& c : *node->as_node())
+        {
+          work.push_back(c.second);
+        }
+      }
+    };
+    auto index_of = [&](node_base_type const* node)
+    {
+      auto it = t.index.find(node);
+      if (it != t.index.end())
+      {
+        return it->second;
+      }
+      const size_type i = t.nodes.size();
+      t.nodes.push_back(node);
+      t.regions.push_back({ 0, 0, 0, 0, 0 });
+      t.index.emplace(node, i);
+      flat.nodes.emplace_back();
+      flat.layout = flatten_layout_t::unordered;
+      work.push_back(node);
+      push_neighbours(node);
+      return i;
+    };
+
+    // root is always at index 0
+    node_base_type const* root_node = _root;
+    auto root_it = t.index.find(root_node);
+    if (root_it == t.index.end() || root_it->second != 0)
+    {
+      flat.layout = flatten_layout_t::unordered;
+      node_base_type const* old = t.nodes[0];
+      if (root_it != t.index.end())
+      {
+        const size_type j = root_it->second;
+        std::swap(t.regions[0], t.regions[j]);
+        t.nodes[j] = old;
+        if (old)
+        {
+          t.index[old] = j;
+        }
+      }
+      else if (old)
+      {
+        const size_type j = t.nodes.size();
+        t.nodes.push_back(old);
+        t.regions.push_back(t.regions[0]);
+        t.regions[0] = { 0, 0, 0, 0, 0 };
+        t.index[old] = j;
+        flat.nodes.emplace_back();
+      }
+      else
+      {
+        t.regions[0] = { 0, 0, 0, 0, 0 };
+      }
+      t.nodes[0] = root_node;
+      t.index[root_node] = 0;
+      work.push_back(root_node);
+      push_neighbours(root_node);
+      if (old)
+      {
+        work.push_back(old);
+        push_neighbours(old);
+      }
+    }
+
+    std::unordered_set<node_base_type const*> written;
+    while (!work.empty())
+    {
+      node_base_type const* node = work.back();
+      work.pop_back();
+      if (!written.insert(node).second)
+      {
+        continue;
+      }
+      const size_type i = index_of(node);
+      const size_type parent = node->parent() ? index_of(node->parent()) : 0;
+      const bool leaf = is_leaf(node);
+      const size_type size
+          = leaf ? node->as_leaf()->size() : node->as_node()->size();
+      typename flat_tracker_t::region_t region = t.regions[i];
+
+      if (size > region.slot_capacity)
+      {
+        flat.layout = flatten_layout_t::unordered;
+        region.slot_offset = flat.children.size();
+        region.slot_capacity = MAX_ENTRIES;
+        flat.children.resize(flat.children.size() + MAX_ENTRIES);
+        flatten_resize(flat.children_bound, flat.children.size(),
+                       leaf ? geometry_type(node->as_leaf()->at(0).first)
+                            : node->as_node()->at(0).first);
+      }
+      if (leaf)
+      {
+        leaf_type const* l = node->as_leaf();
+        if (size > region.data_capacity)
+        {
+          flat.layout = flatten_layout_t::unordered;
+          region.data_offset = flat.data.size();
+          region.data_capacity = MAX_ENTRIES;
+          flatten_resize(flat.data, flat.data.size() + MAX_ENTRIES,
+                         l->at(0).second);
+        }
+        for (size_type c = 0; c < size; ++c)
+        {
+          flat.children_bound[region.slot_offset + c] = l->at(c).first;
+          flat.children[region.slot_offset + c] = region.data_offset + c;
+          flat.data[region.data_offset + c] = l->at(c).second;
+        }
+        add_range(flatten_buffer_t::data, sizeof(mapped_type),
+                  region.data_offset, size);
+      }
+      else
+      {
+        node_type const* n = node->as_node();
+        for (size_type c = 0; c < size; ++c)
+        {
+          const size_type child = index_of(n->at(c).second);
+          flat.children_bound[region.slot_offset + c] = n->at(c).first;
+          flat.children[region.slot_offset + c] = child;
+        }
+      }
+      add_range(flatten_buffer_t::children_bound, sizeof(geometry_type),
+                region.slot_offset, size);
+      add_range(flatten_buffer_t::children, sizeof(size_type),
+                region.slot_offset, size);
+
+      t.live_slots = t.live_slots - region.size + size;
+      region.size = size;
+      if (flat.nodes[i].parent != parent)
+      {
+        // moved to another subtree
+        flat.layout = flatten_layout_t::unordered;
+      }
+      t.regions[i] = region;
+      flat.nodes[i].offset = region.slot_offset;
+      flat.nodes[i].size = size;
+      flat.nodes[i].parent = parent;
+      add_range(flatten_buffer_t::nodes, sizeof(flatten_node_t), i, 1);
+    }
+    flat.leaf_level = leaf_level();
+
+    // sort and merge
+    std::sort(result.ranges.begin(), result.ranges.end(),
+              [](flatten_range_t const& a, flatten_range_t const& b)
+              {
+                return a.buffer != b.buffer ? a.buffer < b.buffer
+                                            : a.offset < b.offset;
+              });
+    std::vector<flatten_range_t> merged;
+    for (flatten_range_t const& r : result.ranges)
+    {
+      if (!merged.empty() && merged.back().buffer == r.buffer
+          && merged.back().offset + merged.back().bytes >= r.offset)
+      {
+        merged.back().bytes = std::max(merged.back().offset
+                                           + merged.back().bytes,
+                                       r.offset + r.bytes)
+                              - merged.back().offset;
+      }
+      else
+      {
+        merged.push_back(r);
+      }
+    }
+    result.ranges = std::move(merged);
+    return result;
   }
 
+  /// read-only query view over `flatten_result_t`;
+  /// `flat_view_type view( flatten_result )`
+  using flat_view_type = flat_rtree_view<geometry_type, mapped_type>;
+
 protected:
+  // calls `functor(thread_query_stats())` only if `Config::stats` is true
+  template <typename Functor>
+  static void record_stats(Functor&& functor)
+  {
+    if constexpr (STATS)
+    {
+      functor(thread_query_stats());
+    }
+  }
+
   template <typename GeometryFilter, typename DataFunctor>
   bool search_recursive(GeometryFilter& geometry_filter,
                         DataFunctor& data_functor,
@@ -989,8 +2508,10 @@ protected:
   {
     if (level == leaf_level())
     {
+      record_stats([&](query_stats& stats) { ++stats.leaves_visited; });
       for (value_type const& element : *node->as_leaf())
       {
+        record_stats([&](query_stats& stats) { ++stats.entries_scanned; });
         if (data_functor(element))
         {
           return true;
@@ -999,36 +2520,145 @@ protected:
     }
     else
     {
+      record_stats([&](query_stats& stats) { ++stats.nodes_visited; });
+      for (typename node_type::value_type const& child : *node->as_node())
+      {
+        record_stats([&](query_stats& stats) { ++stats.filter_calls; });
+        switch (geometry_filter(child.first))
+        {
+        case -1:
+          return true;
+        case 1:
+          if (search_recursive(geometry_filter, data_functor, child.second,
+                               level + 1))
+          {
+            return true;
+          }
+          break;
+        default:
+          record_stats(
+              [&](query_stats& stats)
+              {
+                stats.max_prune_depth
+                    = std::max(stats.max_prune_depth, level + 1);
+              });
+        }
+      }
+    }
+    return false;
+  }
+
+  template <typename GeometryFilter, typename DataFunctor>
+  bool search_recursive(GeometryFilter& geometry_filter,
+                        DataFunctor& data_functor,
+                        node_base_type* node,
+                        int level)
+  {
+    if (level == leaf_level())
+    {
+      record_stats([&](query_stats& stats) { ++stats.leaves_visited; });
+      for (value_type& element : *node->as_leaf())
+      {
+        record_stats([&](query_stats& stats) { ++stats.entries_scanned; });
+        if (data_functor(element))
+        {
+          return true;
+        }
+      }
+    }
+    else
+    {
+      record_stats([&](query_stats& stats) { ++stats.nodes_visited; });
+      for (typename node_type::value_type& child : *node->as_node())
+      {
+        record_stats([&](query_stats& stats) { ++stats.filter_calls; });
+        switch (geometry_filter(child.first))
+        {
+        case -1:
+          return true;
+        case 1:
+          if (search_recursive(geometry_filter, data_functor, child.second,
+                               level + 1))
+          {
+            return true;
+          }
+          break;
+        default:
+          record_stats(
+              [&](query_stats& stats)
+              {
+                stats.max_prune_depth
+                    = std::max(stats.max_prune_depth, level + 1);
+              });
+        }
+      }
+    }
+    return false;
+  }
+
+  template <typename GeometryFilter, typename ConstItFunctor>
+  bool search_iterator_recursive(GeometryFilter& geometry_filter,
+                                 ConstItFunctor& it_functor,
+                                 node_base_type const* node,
+                                 int level) const
+  {
+    if (level == leaf_level())
+    {
+      record_stats([&](query_stats& stats) { ++stats.leaves_visited; });
+      leaf_type const* leaf = node->as_leaf();
+      for (value_type const& element : *leaf)
+      {
+        record_stats([&](query_stats& stats) { ++stats.entries_scanned; });
+        if (it_functor(const_iterator(&element, leaf)))
+        {
+          return true;
+        }
+      }
+    }
+    else
+    {
+      record_stats([&](query_stats& stats) { ++stats.nodes_visited; });
       for (typename node_type::value_type const& child : *node->as_node())
       {
+        record_stats([&](query_stats& stats) { ++stats.filter_calls; });
         switch (geometry_filter(child.first))
         {
         case -1:
           return true;
         case 1:
-          if (search_recursive(geometry_filter, data_functor, child.second,
-                               level + 1))
+          if (search_iterator_recursive(geometry_filter, it_functor,
+                                        child.second, level + 1))
           {
             return true;
           }
-        default:;
+          break;
+        default:
+          record_stats(
+              [&](query_stats& stats)
+              {
+                stats.max_prune_depth
+                    = std::max(stats.max_prune_depth, level + 1);
+              });
         }
       }
     }
     return false;
   }
 
-  template <typename GeometryFilter, typename DataFunctor>
-  bool search_recursive(GeometryFilter& geometry_filter,
-                        DataFunctor& data_functor,
-                        node_base_type* node,
-                        int level)
+  template <typename GeometryFilter, typename ItFunctor>
+  bool search_iterator_recursive(GeometryFilter& geometry_filter,
+                                 ItFunctor& it_functor,
+                                 node_base_type* node,
+                                 int level)
   {
     if (level == leaf_level())
     {
-      for (value_type& element : *node->as_leaf())
+      record_stats([&](query_stats& stats) { ++stats.leaves_visited; });
+      leaf_type* leaf = node->as_leaf();
+      for (value_type& element : *leaf)
       {
-        if (data_functor(element))
+        record_stats([&](query_stats& stats) { ++stats.entries_scanned; });
+        if (it_functor(iterator(&element, leaf)))
         {
           return true;
         }
@@ -1036,101 +2666,147 @@ protected:
     }
     else
     {
+      record_stats([&](query_stats& stats) { ++stats.nodes_visited; });
       for (typename node_type::value_type& child : *node->as_node())
       {
+        record_stats([&](query_stats& stats) { ++stats.filter_calls; });
         switch (geometry_filter(child.first))
         {
         case -1:
           return true;
         case 1:
-          if (search_recursive(geometry_filter, data_functor, child.second,
-                               level + 1))
+          if (search_iterator_recursive(geometry_filter, it_functor,
+                                        child.second, level + 1))
           {
             return true;
           }
-        default:;
+          break;
+        default:
+          record_stats(
+              [&](query_stats& stats)
+              {
+                stats.max_prune_depth
+                    = std::max(stats.max_prune_depth, level + 1);
+              });
         }
       }
     }
     return false;
   }
 
-  template <typename GeometryFilter, typename ConstItFunctor>
-  bool search_iterator_recursive(GeometryFilter& geometry_filter,
-                                 ConstItFunctor& it_functor,
-                                 node_base_type const* node,
-                                 int level) const
+  // `active[level]` is the list of query indices overlapping `node`
+  template <typename QueryIterator, typename BatchFunctor>
+  bool search_batch_recursive(QueryIterator queries,
+                              BatchFunctor& batch_functor,
+                              std::vector<std::vector<size_type>>& active,
+                              node_base_type const* node,
+                              int level) const
   {
+    std::vector<size_type> const& node_queries = active[level];
     if (level == leaf_level())
     {
-      if (!node->as_leaf()->empty())
+      record_stats([&](query_stats& stats) { ++stats.leaves_visited; });
+      for (value_type const& element : *node->as_leaf())
       {
-        for (auto it = const_iterator(&node->as_leaf()->at(0), node->as_leaf());
-             it != const_iterator(); ++it)
+        record_stats([&](query_stats& stats) { ++stats.entries_scanned; });
+        for (size_type q : node_queries)
         {
-          if (it_functor(it))
+          if (helper::is_overlap(element.first, queries[q]))
           {
-            return true;
+            record_stats([&](query_stats& stats) { ++stats.results; });
+            if (batch_functor(q, element))
+            {
+              return true;
+            }
           }
         }
       }
     }
     else
     {
+      record_stats([&](query_stats& stats) { ++stats.nodes_visited; });
+      std::vector<size_type>& child_queries = active[level + 1];
       for (typename node_type::value_type const& child : *node->as_node())
       {
-        switch (geometry_filter(child.first))
+        // one overlap test per active query
+        record_stats([&](query_stats& stats)
+                     { stats.filter_calls += node_queries.size(); });
+        child_queries.clear();
+        for (size_type q : node_queries)
         {
-        case -1:
-          return true;
-        case 1:
-          if (search_recursive(geometry_filter, it_functor, child.second,
-                               level + 1))
+          if (helper::is_overlap(child.first, queries[q]))
           {
-            return true;
+            child_queries.push_back(q);
           }
-        default:;
+        }
+        if (child_queries.empty())
+        {
+          record_stats(
+              [&](query_stats& stats)
+              {
+                stats.max_prune_depth
+                    = std::max(stats.max_prune_depth, level + 1);
+              });
+          continue;
+        }
+        if (search_batch_recursive(queries, batch_functor, active, child.second,
+                                   level + 1))
+        {
+          return true;
         }
       }
     }
     return false;
   }
 
-  template <typename GeometryFilter, typename ItFunctor>
-  bool search_iterator_recursive(GeometryFilter& geometry_filter,
-                                 ItFunctor& it_functor,
-                                 node_base_type* node,
-                                 int level)
+  // writes hits to every non-null output column;
+  // returns true if the capacity ran out before the traversal finished
+  template <typename QueryType>
+  bool query_into_recursive(QueryType const& window,
+                            key_type* keys,
+                            mapped_type* mapped,
+                            value_type* values,
+                            size_type capacity,
+                            size_type& count,
+                            node_base_type const* node,
+                            int level) const
   {
     if (level == leaf_level())
     {
-      if (!node->as_leaf()->empty())
+      for (value_type const& element : *node->as_leaf())
       {
-        for (auto it = iterator(&node->as_leaf()->at(0), node->as_leaf());
-             it != iterator(); ++it)
+        if (!helper::is_overlap(element.first, window))
         {
-          if (it_functor(it))
-          {
-            return true;
-          }
+          continue;
+        }
+        if (count == capacity)
+        {
+          return true;
+        }
+        if (keys)
+        {
+          keys[count] = element.first;
+        }
+        if (mapped)
+        {
+          mapped[count] = element.second;
+        }
+        if (values)
+        {
+          values[count] = element;
         }
+        ++count;
       }
     }
     else
     {
-      for (typename node_type::value_type& child : *node->as_node())
+      for (typename node_type::value_type const& child : *node->as_node())
       {
-        switch (geometry_filter(child.first))
+        if (helper::is_overlap(child.first, window)
+            && query_into_recursive(window, keys, mapped, values, capacity,
+                                    count, child.second, level + 1))
         {
-        case -1:
           return true;
-        case 1:
-          if (search_recursive(geometry_filter, it_functor, child.second,
-                               level + 1))
-          {
-            return true;
-          }
-        default:;
         }
       }
     }
@@ -1151,6 +2827,145 @@ public:
     search_recursive(geometry_filter, data_functor, root(), 0);
   }
 
+  /// limits of a single search; zero means no limit
+  struct search_limit_t
+  {
+    // maximum number of nodes visited, including the root
+    size_type max_nodes = 0;
+    // maximum number of values passed to the data functor
+    size_type max_results = 0;
+    std::chrono::steady_clock::time_point deadline
+        = std::chrono::steady_clock::time_point::max();
+    // the clock is read once every `check_interval` nodes
+    size_type check_interval = 64;
+  };
+
+protected:
+  struct search_budget_t
+  {
+    search_limit_t const& limit;
+    size_type nodes = 0;
+    size_type results = 0;
+    bool exhausted = false;
+
+    bool visit_node()
+    {
+      ++nodes;
+      if (limit.max_nodes && nodes > limit.max_nodes)
+      {
+        exhausted = true;
+      }
+      else if (limit.check_interval && nodes % limit.check_interval == 0
+               && std::chrono::steady_clock::now() >= limit.deadline)
+      {
+        exhausted = true;
+      }
+      return !exhausted;
+    }
+    // called for every value about to be passed; false if the limit was
+    // reached before it, so the value is left out
+    bool add_result()
+    {
+      if (limit.max_results && results == limit.max_results)
+      {
+        exhausted = true;
+        return false;
+      }
+      ++results;
+      return true;
+    }
+  };
+
+  // runs `self.search()` with filters wrapped by the budget counters
+  template <typename Self,
+            typename GeometryFilter,
+            typename ValueFilter,
+            typename DataFunctor>
+  static bool search_limited(Self& self,
+                             GeometryFilter& geometry_filter,
+                             ValueFilter& value_filter,
+                             DataFunctor& data_functor,
+                             search_limit_t const& limit)
+  {
+    search_budget_t budget { limit };
+    auto limited_geometry_filter = [&](geometry_type const& bound) -> int
+    {
+      const int ret = geometry_filter(bound);
+      if (ret == 1 && !budget.visit_node())
+      {
+        return -1;
+      }
+      return ret;
+    };
+    auto limited_data_functor = [&](auto& value) -> bool
+    {
+      if (!value_filter(value))
+      {
+        return false;
+      }
+      if (!budget.add_result())
+      {
+        return true;
+      }
+      record_stats([&](query_stats& stats) { ++stats.results; });
+      return data_functor(value);
+    };
+    if (budget.visit_node())
+    {
+      self.search(limited_geometry_filter, limited_data_functor);
+    }
+    return !budget.exhausted;
+  }
+
+public:
+  /// search with node-visit, result and time limits.
+  /// returns false if the search was cut by `limit`,
+  /// i.e. the values passed to `data_functor` may be incomplete;
+  /// exactly `max_results` values with none left is complete
+  template <typename GeometryFilter, typename ConstDataFunctor>
+  bool search(GeometryFilter&& geometry_filter,
+              ConstDataFunctor&& data_functor,
+              search_limit_t const& limit) const
+  {
+    accept_all_t value_filter;
+    return search_limited(*this, geometry_filter, value_filter, data_functor,
+                          limit);
+  }
+
+  template <typename GeometryFilter, typename DataFunctor>
+  bool search(GeometryFilter&& geometry_filter,
+              DataFunctor&& data_functor,
+              search_limit_t const& limit)
+  {
+    accept_all_t value_filter;
+    return search_limited(*this, geometry_filter, value_filter, data_functor,
+                          limit);
+  }
+
+  /// limited search passing only values accepted by `value_filter`;
+  /// rejected values are not counted toward `max_results`
+  template <typename GeometryFilter,
+            typename ValueFilter,
+            typename ConstDataFunctor>
+  bool search(GeometryFilter&& geometry_filter,
+              ValueFilter&& value_filter,
+              ConstDataFunctor&& data_functor,
+              search_limit_t const& limit) const
+  {
+    return search_limited(*this, geometry_filter, value_filter, data_functor,
+                          limit);
+  }
+
+  template <typename GeometryFilter, typename ValueFilter, typename DataFunctor>
+  bool search(GeometryFilter&& geometry_filter,
+              ValueFilter&& value_filter,
+              DataFunctor&& data_functor,
+              search_limit_t const& limit)
+  {
+    return search_limited(*this, geometry_filter, value_filter, data_functor,
+                          limit);
+  }
+
   template <typename GeometryFilter, typename ItFunctor>
   void search_iterator(GeometryFilter&& geometry_filter,
                        ItFunctor&& it_functor) const
@@ -1164,6 +2979,535 @@ public:
     search_iterator_recursive(geometry_filter, it_functor, root(), 0);
   }
 
+  /// lazy range of values matching the query.
+  /// values are searched on demand while iterating through the range.
+  template <typename GeometryFilter, typename ValueFilter = accept_all_t>
+  range_t<const_query_iterator<std::decay_t<GeometryFilter>,
+                               std::decay_t<ValueFilter>>>
+  query_range(GeometryFilter&& geometry_filter,
+              ValueFilter&& value_filter = ValueFilter()) const
+  {
+    using iterator_type = const_query_iterator<std::decay_t<GeometryFilter>,
+                                               std::decay_t<ValueFilter>>;
+    return { iterator_type(_root, _leaf_level, geometry_filter, value_filter),
+             iterator_type(geometry_filter, value_filter) };
+  }
+
+  /// lazy range of values matching the query.
+  /// values are searched on demand while iterating through the range.
+  template <typename GeometryFilter, typename ValueFilter = accept_all_t>
+  range_t<
+      query_iterator<std::decay_t<GeometryFilter>, std::decay_t<ValueFilter>>>
+  query_range(GeometryFilter&& geometry_filter,
+              ValueFilter&& value_filter = ValueFilter())
+  {
+    using iterator_type = query_iterator<std::decay_t<GeometryFilter>,
+                                         std::decay_t<ValueFilter>>;
+    return { iterator_type(_root, _leaf_level, geometry_filter, value_filter),
+             iterator_type(geometry_filter, value_filter) };
+  }
+
+  /// save the position of the query iterator,
+  /// which can be resumed later by `resume_query()`
+  template <typename LeafType,
+            typename GeometryFilter,
+            typename ValueFilter,
+            bool Stats>
+  query_token_t query_token(
+      query_iterator_t<LeafType, GeometryFilter, ValueFilter, Stats> const& it)
+      const
+  {
+    query_token_t token;
+    token.epoch = _epoch;
+    if (it._pointer == nullptr)
+    {
+      return token;
+    }
+    token.path.push_back(it._pointer - it._leaf->data());
+    node_base_type const* node = it._leaf;
+    while (node->parent())
+    {
+      token.path.push_back(node->_index_on_parent);
+      node = node->parent();
+    }
+    std::reverse(token.path.begin(), token.path.end());
+    return token;
+  }
+
+protected:
+  // moves `it` of `self` to the position saved in `token`
+  template <typename Self, typename IteratorType>
+  static bool resume_query_impl(Self& self,
+                                query_token_t const& token,
+                                IteratorType& it)
+  {
+    if (token.epoch != self._epoch)
+    {
+      return false;
+    }
+    if (token.path.empty())
+    {
+      it._leaf = nullptr;
+      it._pointer = nullptr;
+      return true;
+    }
+    if (token.path.size() != size_type(self._leaf_level) + 1)
+    {
+      return false;
+    }
+    auto* node = self.root();
+    for (int level = 0; level < self._leaf_level; ++level)
+    {
+      if (token.path[level] >= node->size())
+      {
+        return false;
+      }
+      node = node->at(token.path[level]).second->as_node();
+    }
+    auto* leaf = node->as_leaf();
+    if (token.path.back() >= leaf->size())
+    {
+      return false;
+    }
+    it._leaf = leaf;
+    it._pointer = &leaf->at(token.path.back());
+    return true;
+  }
+
+public:
+  /// move the query iterator to the position saved in `token`.
+  /// returns false if the tree was modified after the token was saved,
+  /// or the token is not valid for this tree; `it` is not changed then.
+  template <typename GeometryFilter, typename ValueFilter>
+  bool resume_query(query_token_t const& token,
+                    const_query_iterator<GeometryFilter, ValueFilter>& it) const
+  {
+    return resume_query_impl(*this, token, it);
+  }
+  template <typename GeometryFilter, typename ValueFilter>
+  bool resume_query(query_token_t const& token,
+                    query_iterator<GeometryFilter, ValueFilter>& it)
+  {
+    return resume_query_impl(*this, token, it);
+  }
+
+  /// (number of values written, whether the output was too small)
+  struct query_into_result_t
+  {
+    size_type count = 0;
+    bool truncated = false;
+  };
+
+  /// write every value whose key overlaps `window` into contiguous columns.
+  /// `keys` and `mapped` are arrays of at least `capacity` elements;
+  /// either of them can be nullptr to skip the column.
+  /// stops at `capacity` values and sets `truncated` if more remain.
+  template <typename QueryType>
+  query_into_result_t query_into(QueryType const& window,
+                                 key_type* keys,
+                                 mapped_type* mapped,
+                                 size_type capacity) const
+  {
+    query_into_result_t ret;
+    ret.truncated = query_into_recursive(window, keys, mapped, nullptr,
+                                         capacity, ret.count, root(), 0);
+    return ret;
+  }
+  /// write mapped values of every key overlapping `window` into `out`
+  template <typename QueryType>
+  query_into_result_t query_into(QueryType const& window,
+                                 mapped_type* out,
+                                 size_type capacity) const
+  {
+    return query_into(window, nullptr, out, capacity);
+  }
+  /// write every value whose key overlaps `window` into `out`
+  template <typename QueryType>
+  query_into_result_t query_into(QueryType const& window,
+                                 value_type* out,
+                                 size_type capacity) const
+  {
+    query_into_result_t ret;
+    ret.truncated = query_into_recursive(window, nullptr, nullptr, out,
+                                         capacity, ret.count, root(), 0);
+    return ret;
+  }
+
+  /// search every query window in [first, last) with a single traversal.
+  /// `batch_functor(query_index, value)` is called for each value whose key
+  /// overlaps the `query_index`-th window.
+  /// If the return value is `true`, the whole batch immediately stops.
+  template <typename QueryIterator, typename BatchFunctor>
+  void search_batch(QueryIterator first,
+                    QueryIterator last,
+                    BatchFunctor&& batch_functor) const
+  {
+    const size_type count = std::distance(first, last);
+    if (count == 0)
+    {
+      return;
+    }
+
+    // sort queries along the hilbert curve,
+    // so that nearby windows stay adjacent in the per-node query list
+    geometry_type world = first[0];
+    for (size_type q = 1; q < count; ++q)
+    {
+      helper::enlarge_to(world, first[q]);
+    }
+    const hilbert_mapper_t<geometry_type> mapper(world);
+    std::vector<std::pair<std::uint64_t, size_type>> curve;
+    curve.reserve(count);
+    for (size_type q = 0; q < count; ++q)
+    {
+      curve.emplace_back(mapper(first[q]), q);
+    }
+    std::sort(curve.begin(), curve.end());
+
+    std::vector<std::vector<size_type>> active(leaf_level() + 1);
+    active[0].reserve(count);
+    for (auto const& c : curve)
+    {
+      active[0].push_back(c.second);
+    }
+    search_batch_recursive(first, batch_functor, active, root(), 0);
+  }
+
+  /// (distance, iterator) pair of nearest neighbour query
+  using nearest_value_type = std::pair<scalar_type, const_iterator>;
+
+  /// options for approximate nearest neighbour query
+  struct nearest_option_t
+  {
+    /// a node is pruned if its distance * (1 + epsilon) is not less than
+    /// the k-th best distance found so far, both as measured by `metric`.
+    /// results are within factor (1 + epsilon) of the exact k-th value of
+    /// `metric`; for the squared `EuclideanMetric`, the actual distances
+    /// are within factor sqrt(1 + epsilon)
+    double epsilon = 0;
+
+    /// maximum number of nodes to visit; 0 for unlimited.
+    /// when reached, the best results found so far are returned
+    size_type max_visits = 0;
+  };
+
+  /// reusable buffers for nearest neighbour query
+  struct nearest_buffer_t
+  {
+    struct candidate_t
+    {
+      scalar_type distance;
+      node_base_type const* node;
+      int level;
+    };
+
+    /// min-heap of nodes to visit
+    std::vector<candidate_t> candidates;
+
+    /// max-heap of best k results found so far
+    std::vector<nearest_value_type> results;
+
+    /// number of nodes visited by the last query
+    size_type visits = 0;
+  };
+
+protected:
+  // best-first k nearest neighbour search;
+  // buffer.results is sorted by increasing distance on return
+  template <typename PointType, typename Metric>
+  void nearest_best_first(PointType const& point,
+                          size_type k,
+                          Metric const& metric,
+                          nearest_option_t const& option,
+                          nearest_buffer_t& buffer) const
+  {
+    using candidate_t = typename nearest_buffer_t::candidate_t;
+    auto candidate_greater = [](candidate_t const& a, candidate_t const& b)
+    { return a.distance > b.distance; };
+    auto result_less
+        = [](nearest_value_type const& a, nearest_value_type const& b)
+    { return a.first < b.first; };
+    // whether node with distance `d` cannot improve the k-th result
+    const double scale = 1.0 + option.epsilon;
+    auto prunable = [&](scalar_type d)
+    {
+      return buffer.results.size() == k
+             && double(d) * scale >= double(buffer.results.front().first);
+    };
+
+    std::vector<candidate_t>& candidates = buffer.candidates;
+    std::vector<nearest_value_type>& results = buffer.results;
+    candidates.clear();
+    results.clear();
+    buffer.visits = 0;
+    if (k == 0)
+    {
+      return;
+    }
+
+    candidates.push_back({ scalar_type(0), _root, 0 });
+    while (!candidates.empty())
+    {
+      std::pop_heap(candidates.begin(), candidates.end(), candidate_greater);
+      const candidate_t c = candidates.back();
+      candidates.pop_back();
+
+      // every remaining node is farther than k-th result
+      if (prunable(c.distance))
+      {
+        break;
+      }
+      if (option.max_visits != 0 && buffer.visits == option.max_visits)
+      {
+        break;
+      }
+      ++buffer.visits;
+
+      if (c.level == leaf_level())
+      {
+        leaf_type const* leaf = c.node->as_leaf();
+        record_stats(
+            [&](query_stats& stats)
+            {
+              ++stats.leaves_visited;
+              stats.entries_scanned += leaf->size();
+            });
+        for (value_type const& element : *leaf)
+        {
+          const scalar_type d = metric.distance(element.first, point);
+          if (results.size() < k)
+          {
+            results.emplace_back(d, const_iterator(&element, leaf));
+            std::push_heap(results.begin(), results.end(), result_less);
+          }
+          else if (d < results.front().first)
+          {
+            std::pop_heap(results.begin(), results.end(), result_less);
+            results.back() = { d, const_iterator(&element, leaf) };
+            std::push_heap(results.begin(), results.end(), result_less);
+          }
+        }
+      }
+      else
+      {
+        node_type const* node = c.node->as_node();
+        record_stats(
+            [&](query_stats& stats)
+            {
+              ++stats.nodes_visited;
+              stats.filter_calls += node->size();
+            });
+        for (typename node_type::value_type const& child : *node)
+        {
+          const scalar_type d = metric.min_distance(child.first, point);
+          if (!prunable(d))
+          {
+            candidates.push_back({ d, child.second, c.level + 1 });
+            std::push_heap(candidates.begin(), candidates.end(),
+                           candidate_greater);
+          }
+          else
+          {
+            record_stats(
+                [&](query_stats& stats)
+                {
+                  stats.max_prune_depth
+                      = std::max(stats.max_prune_depth, c.level + 1);
+                });
+          }
+        }
+      }
+    }
+    std::sort_heap(results.begin(), results.end(), result_less);
+    record_stats([&](query_stats& stats) { stats.results += results.size(); });
+  }
+
+public:
+  /// find k nearest values from `point`, in increasing order of distance
+  /// measured by `metric`.
+  /// writes `nearest_value_type` to `out` and returns the number of results
+  template <typename PointType,
+            typename OutputIterator,
+            typename Metric = EuclideanMetric>
+  size_type nearest(PointType const& point,
+                    size_type k,
+                    OutputIterator out,
+                    Metric const& metric = Metric()) const
+  {
+    nearest_buffer_t buffer;
+    return nearest(point, k, out, metric, buffer);
+  }
+  /// find k nearest values from `point`, reusing the given buffer
+  template <typename PointType, typename OutputIterator, typename Metric>
+  size_type nearest(PointType const& point,
+                    size_type k,
+                    OutputIterator out,
+                    Metric const& metric,
+                    nearest_buffer_t& buffer) const
+  {
+    nearest_best_first(point, k, metric, nearest_option_t(), buffer);
+    std::copy(buffer.results.begin(), buffer.results.end(), out);
+    return buffer.results.size();
+  }
+
+  /// approximate k nearest values from `point`,
+  /// with relative error bound `option.epsilon` and node visit limit
+  /// `option.max_visits`.
+  /// writes `nearest_value_type` to `out` and returns the number of results
+  template <typename PointType,
+            typename OutputIterator,
+            typename Metric = EuclideanMetric>
+  size_type nearest_approximate(PointType const& point,
+                                size_type k,
+                                OutputIterator out,
+                                nearest_option_t const& option,
+                                Metric const& metric = Metric()) const
+  {
+    nearest_buffer_t buffer;
+    return nearest_approximate(point, k, out, option, metric, buffer);
+  }
+  /// approximate k nearest values from `point`, reusing the given buffer
+  template <typename PointType, typename OutputIterator, typename Metric>
+  size_type nearest_approximate(PointType const& point,
+                                size_type k,
+                                OutputIterator out,
+                                nearest_option_t const& option,
+                                Metric const& metric,
+                                nearest_buffer_t& buffer) const
+  {
+    nearest_best_first(point, k, metric, option, buffer);
+    std::copy(buffer.results.begin(), buffer.results.end(), out);
+    return buffer.results.size();
+  }
+
+  /// k nearest neighbour query for every point in [first, last).
+  /// results of i-th point are written to out[i*k, i*k+k);
+  /// unfilled slots are set to { max(), const_iterator() }.
+  /// queries are partitioned over `threads` worker threads
+  /// ( 0 for std::thread::hardware_concurrency() ).
+  template <typename PointIterator,
+            typename RandomAccessIterator,
+            typename Metric = EuclideanMetric>
+  void nearest_batch(PointIterator first,
+                     PointIterator last,
+                     size_type k,
+                     RandomAccessIterator out,
+                     unsigned int threads = 0,
+                     Metric const& metric = Metric()) const
+  {
+    const size_type count = std::distance(first, last);
+    if (count == 0 || k == 0)
+    {
+      return;
+    }
+
+    // sort queries along the hilbert curve,
+    // so that consecutive queries on a thread visit the same nodes
+    geometry_type world = first[0];
+    for (size_type q = 1; q < count; ++q)
+    {
+      helper::enlarge_to(world, first[q]);
+    }
+    const hilbert_mapper_t<geometry_type> mapper(world);
+    std::vector<std::pair<std::uint64_t, size_type>> curve;
+    curve.reserve(count);
+    for (size_type q = 0; q < count; ++q)
+    {
+      curve.emplace_back(mapper(first[q]), q);
+    }
+    std::sort(curve.begin(), curve.end());
+
+    if (threads == 0)
+    {
+      threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threads = std::min<size_type>(threads, count);
+    const size_type chunk = (count + threads - 1) / threads;
+
+    auto work = [&](size_type begin, size_type end)
+    {
+      nearest_buffer_t buffer;
+      for (size_type i = begin; i < end; ++i)
+      {
+        const size_type q = curve[i].second;
+        nearest_best_first(first[q], k, metric, nearest_option_t(), buffer);
+
+        // in std::size_t; q * k may not fit in size_type
+        const std::size_t base = std::size_t(q) * std::size_t(k);
+        const size_type found = buffer.results.size();
+        for (size_type j = 0; j < found; ++j)
+        {
+          out[base + j] = buffer.results[j];
+        }
+        for (size_type j = found; j < k; ++j)
+        {
+          out[base + j] = nearest_value_type(
+              std::numeric_limits<scalar_type>::max(), const_iterator());
+        }
+      }
+    };
+
+    // counters of each worker, summed into the caller's sink after join
+    std::vector<query_stats> worker_stats(threads);
+    std::vector<std::thread> workers;
+    for (size_type t = 1; t < threads; ++t)
+    {
+      workers.emplace_back(
+          [&, t]()
+          {
+            work(std::min(count, t * chunk), std::min(count, (t + 1) * chunk));
+            record_stats([&](query_stats& stats) { worker_stats[t] = stats; });
+          });
+    }
+    work(0, std::min(count, chunk));
+    for (std::thread& worker : workers)
+    {
+      worker.join();
+    }
+    record_stats(
+        [&](query_stats& stats)
+        {
+          for (size_type t = 1; t < threads; ++t)
+          {
+            stats += worker_stats[t];
+          }
+        });
+  }
+
+  /// fill factor, overlap, dead space, margin and aspect ratio of nodes,
+  /// per level. see `level_quality_t`
+  quality_report_t quality_report() const
+  {
+    quality_report_t report;
+    report.levels.resize(_leaf_level + 1);
+    for (int level = 0; level < _leaf_level; ++level)
+    {
+      for (auto ni = node_begin(level); ni != node_end(level); ++ni)
+      {
+        helper::add_node_quality(report.levels[level], (*ni)->calculate_bound(),
+                                 (*ni)->begin(), (*ni)->end(), MAX_ENTRIES);
+      }
+    }
+    for (auto li = leaf_begin(); li != leaf_end(); ++li)
+    {
+      if ((*li)->empty())
+      {
+        continue;
+      }
+      helper::add_node_quality(report.levels[_leaf_level],
+                               (*li)->calculate_bound(), (*li)->begin(),
+                               (*li)->end(), MAX_ENTRIES);
+    }
+    for (level_quality_t& level : report.levels)
+    {
+      if (level.node_count)
+      {
+        level.average_fill /= level.node_count;
+      }
+    }
+    return report;
+  }
+
   /// Rebalance the tree.
   /// This function reinserts all the elements in the tree, so that its bounding
   /// box distribution is more balanced.
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+
+#include "global.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+/*
+  Stream format of `RTree::save()` and `RTree::load()`.
+
+  tree_file_header_t
+  root node record, depth-first:
+    uint32 size
+    normal node: size * { geometry_type bound, child node record }
+    leaf node:   size * { key_type key, mapped_type by the serializer }
+
+  Bounds and keys are stored as raw bytes in native byte order; `endian`
+  and the sizes in the header reject streams from a different platform or
+  with different types.
+
+  A serializer for `mapped_type` must implement
+
+  void write(std::ostream& os, mapped_type const& value) const;
+  // returns false on failure
+  bool read(std::istream& is, mapped_type& value) const;
+*/
+
+constexpr std::uint32_t TREE_FILE_VERSION = 1;
+constexpr std::uint32_t TREE_FILE_ENDIAN = 0x01020304;
+
+struct tree_file_header_t
+{
+  char magic[8];
+  std::uint32_t version;
+  /// TREE_FILE_ENDIAN in writer's byte order
+  std::uint32_t endian;
+  std::uint32_t dimension;
+  std::uint32_t leaf_level;
+  std::uint32_t geometry_size;
+  std::uint32_t key_size;
+  /// sizeof(mapped_type) of the writer
+  std::uint32_t mapped_size;
+  std::uint32_t reserved;
+  /// the number of values
+  std::uint64_t size;
+};
+
+// raw bytes of trivially copyable `mapped_type`
+struct RawSerializer
+{
+  template <typename T>
+  void write(std::ostream& os, T const& value) const
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "RawSerializer requires trivially copyable mapped_type");
+    os.write(reinterpret_cast<char const*>(&value), sizeof(T));
+  }
+  template <typename T>
+  bool read(std::istream& is, T& value) const
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "RawSerializer requires trivially copyable mapped_type");
+    return bool(is.read(reinterpret_cast<char*>(&value), sizeof(T)));
+  }
+};
+
+namespace helper
+{
+template <typename T>
+void write_raw(std::ostream& os, T const& value)
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "stored type must be trivially copyable");
+  os.write(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+template <typename T>
+bool read_raw(std::istream& is, T& value)
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "stored type must be trivially copyable");
+  return bool(is.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+// storage of raw bytes of `T`;
+// for trivially copyable types without default constructor
+template <typename T>
+struct raw_value_t
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "stored type must be trivially copyable");
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+  bool read(std::istream& is)
+  {
+    return bool(is.read(reinterpret_cast<char*>(&storage), sizeof(T)));
+  }
+  T const& get() const
+  {
+    return *reinterpret_cast<T const*>(&storage);
+  }
+};
+}
+
+}
+} // namespace eh, rtree
@@ -260,6 +260,32 @@ struct static_node_t
     child.second->_index_on_parent = size();
     _children.emplace_back(std::move(child));
   }
+  // insert child node at `index`, keeping the order of the others
+  void insert(size_type index, value_type child)
+  {
+    EH_RTREE_ASSERT_SILENT(size() < MaxEntry);
+    EH_RTREE_ASSERT_SILENT(index <= size());
+    child.second->_parent = this;
+    _children.emplace_back(std::move(child));
+    for (size_type i = size() - 1; i > index; --i)
+    {
+      std::swap(at(i), at(i - 1));
+      at(i).second->_index_on_parent = i;
+    }
+    at(index).second->_index_on_parent = index;
+  }
+  // erase child node at `index`, keeping the order of the others
+  void erase_at(size_type index)
+  {
+    EH_RTREE_ASSERT_SILENT(index < size());
+    at(index).second->_parent = nullptr;
+    for (size_type i = index; i + 1 < size(); ++i)
+    {
+      at(i) = std::move(at(i + 1));
+      at(i).second->_index_on_parent = i;
+    }
+    pop_back();
+  }
   void erase(node_base_type* node)
   {
     EH_RTREE_ASSERT_SILENT(node->_parent == this);
@@ -522,6 +548,27 @@ struct static_leaf_node_t
     EH_RTREE_ASSERT_SILENT(size() < MaxEntry);
     _children.emplace_back(std::move(child));
   }
+  // insert data at `index`, keeping the order of the others
+  void insert(size_type index, value_type child)
+  {
+    EH_RTREE_ASSERT_SILENT(size() < MaxEntry);
+    EH_RTREE_ASSERT_SILENT(index <= size());
+    _children.emplace_back(std::move(child));
+    for (size_type i = size() - 1; i > index; --i)
+    {
+      std::swap(at(i), at(i - 1));
+    }
+  }
+  // erase data at `index`, keeping the order of the others
+  void erase_at(size_type index)
+  {
+    EH_RTREE_ASSERT_SILENT(index < size());
+    for (size_type i = index; i + 1 < size(); ++i)
+    {
+      at(i) = std::move(at(i + 1));
+    }
+    pop_back();
+  }
   void erase(value_type* pos)
   {
     EH_RTREE_ASSERT_SILENT(size() > 0);
@@ -0,0 +1,445 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "geometry_traits.hpp"
+#include "global.hpp"
+#include "hilbert.hpp"
+#include "metric.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+/*
+  Packed Hilbert R-Tree for immutable data sets.
+
+  Values are sorted by the Hilbert index of the center of their keys, and
+  packed into full nodes of `NodeSize` entries, level by level up to the
+  root. Every level is a contiguous run of bounds in a single array;
+  children of node `i` are nodes ( or values ) [i*NodeSize, (i+1)*NodeSize)
+  of the level below, so no child pointers, parent pointers or per-node
+  allocations are stored.
+
+  Levels are numbered as `RTree`; the root is level 0 and leaf nodes,
+  whose children are values, are on `leaf_level()`.
+*/
+template <typename GeometryType,
+          typename KeyType,
+          typename MappedType,
+          size_type NodeSize = 16>
+class static_rtree
+{
+public:
+  using size_type = ::eh::rtree::size_type;
+
+  using geometry_type = GeometryType;
+  using key_type = KeyType;
+  using mapped_type = MappedType;
+  using value_type = std::pair<key_type, mapped_type>;
+  using traits = geometry_traits<geometry_type>;
+
+  using scalar_type = typename geometry_traits<geometry_type>::scalar_type;
+
+  constexpr static size_type NODE_SIZE = NodeSize;
+  static_assert(NODE_SIZE >= 2, "Invalid NodeSize");
+
+  using iterator = value_type*;
+  using const_iterator = value_type const*;
+
+protected:
+  // values in Hilbert order
+  std::vector<value_type> _values;
+
+  // bounds of every node; leaf level first, root last
+  std::vector<geometry_type> _bounds;
+
+  // index of the first node of each level on `_bounds`, by level
+  std::vector<size_type> _level_offset;
+  // the number of nodes on each level, by level
+  std::vector<size_type> _level_count;
+
+  void build()
+  {
+    _bounds.clear();
+    _level_offset.clear();
+    _level_count.clear();
+    if (_values.empty())
+    {
+      return;
+    }
+
+    // sort along the hilbert curve
+    geometry_type world = geometry_type(_values[0].first);
+    for (value_type const& v : _values)
+    {
+      helper::enlarge_to(world, v.first);
+    }
+    const hilbert_mapper_t<geometry_type> mapper(world);
+    std::vector<std::pair<std::uint64_t, size_type>> curve;
+    curve.reserve(_values.size());
+    for (size_type i = 0; i < _values.size(); ++i)
+    {
+      curve.emplace_back(mapper(_values[i].first), i);
+    }
+    std::sort(curve.begin(), curve.end());
+    std::vector<value_type> sorted;
+    sorted.reserve(_values.size());
+    for (auto const& c : curve)
+    {
+      sorted.push_back(std::move(_values[c.second]));
+    }
+    _values = std::move(sorted);
+
+    // reserve every level at once; leaf level first
+    std::vector<size_type> counts;
+    size_type count = _values.size();
+    size_type total = 0;
+    do
+    {
+      count = (count + NODE_SIZE - 1) / NODE_SIZE;
+      counts.push_back(count);
+      total += count;
+    } while (count > 1);
+    _bounds.reserve(total);
+
+    // leaf nodes
+    for (size_type i = 0; i < _values.size(); i += NODE_SIZE)
+    {
+      const size_type end = std::min(i + NODE_SIZE, size());
+      geometry_type bound = geometry_type(_values[i].first);
+      for (size_type j = i + 1; j < end; ++j)
+      {
+        helper::enlarge_to(bound, _values[j].first);
+      }
+      _bounds.push_back(bound);
+    }
+    // upper levels
+    size_type child_offset = 0;
+    for (size_type l = 1; l < counts.size(); ++l)
+    {
+      const size_type child_count = counts[l - 1];
+      for (size_type i = 0; i < child_count; i += NODE_SIZE)
+      {
+        const size_type end = std::min(i + NODE_SIZE, child_count);
+        geometry_type bound = _bounds[child_offset + i];
+        for (size_type j = i + 1; j < end; ++j)
+        {
+          helper::enlarge_to(bound, _bounds[child_offset + j]);
+        }
+        _bounds.push_back(bound);
+      }
+      child_offset += child_count;
+    }
+
+    // index by level, root first
+    size_type offset = total;
+    for (size_type l = counts.size(); l-- > 0;)
+    {
+      offset -= counts[l];
+      _level_offset.push_back(offset);
+      _level_count.push_back(counts[l]);
+    }
+  }
+
+  // [begin, end) of children of node `index` on `level`
+  std::pair<size_type, size_type> children(int level, size_type index) const
+  {
+    const size_type child_count
+        = level == leaf_level() ? size() : _level_count[level + 1];
+    return { index * NODE_SIZE,
+             std::min(index * NODE_SIZE + NODE_SIZE, child_count) };
+  }
+
+public:
+  static_rtree()
+  {
+  }
+  /// builds the tree from the values in [first, last)
+  template <typename Iterator>
+  static_rtree(Iterator first, Iterator last)
+      : _values(first, last)
+  {
+    build();
+  }
+  /// builds the tree from `values`; they are moved into the tree
+  explicit static_rtree(std::vector<value_type>&& values)
+      : _values(std::move(values))
+  {
+    build();
+  }
+
+  size_type size() const
+  {
+    return _values.size();
+  }
+  bool empty() const
+  {
+    return _values.empty();
+  }
+  /// level of leaf nodes; root is level 0. -1 if empty
+  int leaf_level() const
+  {
+    return int(_level_count.size()) - 1;
+  }
+  /// the number of nodes on `level`
+  size_type node_count(int level) const
+  {
+    return _level_count[level];
+  }
+  /// bounding box of `index`-th node on `level`
+  geometry_type const& node_bound(int level, size_type index) const
+  {
+    return _bounds[_level_offset[level] + index];
+  }
+  /// bounding box of the whole tree; the tree must not be empty
+  geometry_type const& bound() const
+  {
+    EH_RTREE_ASSERT_SILENT(empty() == false);
+    return _bounds.back();
+  }
+
+  /// values in Hilbert order
+  const_iterator begin() const
+  {
+    return _values.data();
+  }
+  const_iterator end() const
+  {
+    return _values.data() + _values.size();
+  }
+
+protected:
+  template <typename GeometryFilter, typename DataFunctor>
+  bool search_recursive(GeometryFilter& geometry_filter,
+                        DataFunctor& data_functor,
+                        int level,
+                        size_type index) const
+  {
+    const std::pair<size_type, size_type> range = children(level, index);
+    if (level == leaf_level())
+    {
+      for (size_type i = range.first; i < range.second; ++i)
+      {
+        if (data_functor(_values[i]))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+    for (size_type i = range.first; i < range.second; ++i)
+    {
+      switch (geometry_filter(node_bound(level + 1, i)))
+      {
+      case -1:
+        return true;
+      case 1:
+        if (search_recursive(geometry_filter, data_functor, level + 1, i))
+        {
+          return true;
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    return false;
+  }
+
+public:
+  /// same as `RTree::search()`;
+  /// `geometry_filter(geometry_type const&)` returns 1 to visit the node,
+  /// 0 to skip it and -1 to stop the search.
+  /// `data_functor(value_type const&)` is called for every value of visited
+  /// leaf nodes; returns true to stop the search
+  template <typename GeometryFilter, typename DataFunctor>
+  void search(GeometryFilter&& geometry_filter,
+              DataFunctor&& data_functor) const
+  {
+    if (empty())
+    {
+      return;
+    }
+    search_recursive(geometry_filter, data_functor, 0, 0);
+  }
+
+  /// (distance, iterator) pair of nearest neighbour query
+  using nearest_value_type = std::pair<scalar_type, const_iterator>;
+
+  /// options for approximate nearest neighbour query;
+  /// same as `RTree::nearest_option_t`
+  struct nearest_option_t
+  {
+    /// a node is pruned if its distance * (1 + epsilon) is not less than
+    /// the k-th best distance found so far, both as measured by `metric`;
+    /// for the squared `EuclideanMetric`, the actual distances are within
+    /// factor sqrt(1 + epsilon)
+    double epsilon = 0;
+
+    /// maximum number of nodes to visit; 0 for unlimited
+    size_type max_visits = 0;
+  };
+
+  /// reusable buffers for nearest neighbour query
+  struct nearest_buffer_t
+  {
+    struct candidate_t
+    {
+      scalar_type distance;
+      int level;
+      size_type index;
+    };
+
+    /// min-heap of nodes to visit
+    std::vector<candidate_t> candidates;
+
+    /// max-heap of best k results found so far
+    std::vector<nearest_value_type> results;
+
+    /// number of nodes visited by the last query
+    size_type visits = 0;
+  };
+
+protected:
+  // best-first k nearest neighbour search;
+  // buffer.results is sorted by increasing distance on return
+  template <typename PointType, typename Metric>
+  void nearest_best_first(PointType const& point,
+                          size_type k,
+                          Metric const& metric,
+                          nearest_option_t const& option,
+                          nearest_buffer_t& buffer) const
+  {
+    using candidate_t = typename nearest_buffer_t::candidate_t;
+    auto candidate_greater = [](candidate_t const& a, candidate_t const& b)
+    { return a.distance > b.distance; };
+    auto result_less
+        = [](nearest_value_type const& a, nearest_value_type const& b)
+    { return a.first < b.first; };
+    const double scale = 1.0 + option.epsilon;
+    auto prunable = [&](scalar_type d)
+    {
+      return buffer.results.size() == k
+             && double(d) * scale >= double(buffer.results.front().first);
+    };
+
+    std::vector<candidate_t>& candidates = buffer.candidates;
+    std::vector<nearest_value_type>& results = buffer.results;
+    candidates.clear();
+    results.clear();
+    buffer.visits = 0;
+    if (k == 0 || empty())
+    {
+      return;
+    }
+
+    candidates.push_back({ scalar_type(0), 0, 0 });
+    while (!candidates.empty())
+    {
+      std::pop_heap(candidates.begin(), candidates.end(), candidate_greater);
+      const candidate_t c = candidates.back();
+      candidates.pop_back();
+
+      if (prunable(c.distance))
+      {
+        break;
+      }
+      if (option.max_visits != 0 && buffer.visits == option.max_visits)
+      {
+        break;
+      }
+      ++buffer.visits;
+
+      const std::pair<size_type, size_type> range
+          = children(c.level, c.index);
+      if (c.level == leaf_level())
+      {
+        for (size_type i = range.first; i < range.second; ++i)
+        {
+          const scalar_type d = metric.distance(_values[i].first, point);
+          if (results.size() < k)
+          {
+            results.emplace_back(d, &_values[i]);
+            std::push_heap(results.begin(), results.end(), result_less);
+          }
+          else if (d < results.front().first)
+          {
+            std::pop_heap(results.begin(), results.end(), result_less);
+            results.back() = { d, &_values[i] };
+            std::push_heap(results.begin(), results.end(), result_less);
+          }
+        }
+      }
+      else
+      {
+        for (size_type i = range.first; i < range.second; ++i)
+        {
+          const scalar_type d
+              = metric.min_distance(node_bound(c.level + 1, i), point);
+          if (!prunable(d))
+          {
+            candidates.push_back({ d, c.level + 1, i });
+            std::push_heap(candidates.begin(), candidates.end(),
+                           candidate_greater);
+          }
+        }
+      }
+    }
+    std::sort_heap(results.begin(), results.end(), result_less);
+  }
+
+public:
+  /// find k nearest values from `point`, in increasing order of distance
+  /// measured by `metric`.
+  /// writes `nearest_value_type` to `out` and returns the number of results
+  template <typename PointType,
+            typename OutputIterator,
+            typename Metric = EuclideanMetric>
+  size_type nearest(PointType const& point,
+                    size_type k,
+                    OutputIterator out,
+                    Metric const& metric = Metric()) const
+  {
+    nearest_buffer_t buffer;
+    return nearest(point, k, out, metric, buffer);
+  }
+  /// find k nearest values from `point`, reusing the given buffer
+  template <typename PointType, typename OutputIterator, typename Metric>
+  size_type nearest(PointType const& point,
+                    size_type k,
+                    OutputIterator out,
+                    Metric const& metric,
+                    nearest_buffer_t& buffer) const
+  {
+    nearest_best_first(point, k, metric, nearest_option_t(), buffer);
+    std::copy(buffer.results.begin(), buffer.results.end(), out);
+    return buffer.results.size();
+  }
+
+  /// approximate k nearest values from `point`,
+  /// with relative error bound `option.epsilon` and node visit limit
+  /// `option.max_visits`
+  template <typename PointType,
+            typename OutputIterator,
+            typename Metric = EuclideanMetric>
+  size_type nearest_approximate(PointType const& point,
+                                size_type k,
+                                OutputIterator out,
+                                nearest_option_t const& option,
+                                Metric const& metric = Metric()) const
+  {
+    nearest_buffer_t buffer;
+    nearest_best_first(point, k, metric, option, buffer);
+    std::copy(buffer.results.begin(), buffer.results.end(), out);
+    return buffer.results.size();
+  }
+};
+
+}
+} // namespace eh rtree
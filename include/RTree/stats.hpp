@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#include "global.hpp"
+
+namespace eh
+{
+namespace rtree
+{
+
+// counters of queries, accumulated into `thread_query_stats()`
+// when `Config::stats` is true.
+struct query_stats
+{
+  // internal nodes visited
+  std::uint64_t nodes_visited = 0;
+  // leaf nodes visited
+  std::uint64_t leaves_visited = 0;
+  // geometry filter (or MINDIST) invocations on children of internal nodes
+  std::uint64_t filter_calls = 0;
+  // values tested in visited leaves
+  std::uint64_t entries_scanned = 0;
+  // values accepted by the query: yielded by query_range(), passed to the
+  // functor of search_batch() or limited search(), or returned by nearest
+  // query. plain search() leaves the choice to its functor
+  std::uint64_t results = 0;
+  // deepest level where a child node was pruned; -1 if none
+  int max_prune_depth = -1;
+
+  void clear()
+  {
+    *this = query_stats();
+  }
+
+  query_stats& operator+=(query_stats const& rhs)
+  {
+    nodes_visited += rhs.nodes_visited;
+    leaves_visited += rhs.leaves_visited;
+    filter_calls += rhs.filter_calls;
+    entries_scanned += rhs.entries_scanned;
+    results += rhs.results;
+    max_prune_depth = std::max(max_prune_depth, rhs.max_prune_depth);
+    return *this;
+  }
+};
+
+// per-thread sink of query statistics; never cleared by the tree
+inline query_stats& thread_query_stats()
+{
+  thread_local query_stats stats;
+  return stats;
+}
+
+// counters of insert and erase, accumulated into `thread_modify_stats()`
+// when `Config::stats` is true.
+// `height` below is the level counted upward from the leaves (leaf = 0).
+struct modify_stats
+{
+  constexpr static int MAX_HEIGHT = 32;
+
+  // node splits per height
+  std::uint64_t splits[MAX_HEIGHT] = {};
+  // overflows treated by forced reinsertion
+  std::uint64_t forced_reinserts = 0;
+  // entries moved by forced reinsertion
+  std::uint64_t reinserted_entries = 0;
+  // underfull nodes removed by erase
+  std::uint64_t erase_orphaned_nodes = 0;
+  // entries of underfull nodes reinserted by erase
+  std::uint64_t erase_reinserted_entries = 0;
+  std::uint64_t root_grows = 0;
+  std::uint64_t root_shrinks = 0;
+  // children compared while choosing subtree for insertion
+  std::uint64_t choose_subtree_comparisons = 0;
+  // most splits caused by a single insert
+  std::uint64_t max_split_cascade = 0;
+
+  std::uint64_t total_splits() const
+  {
+    std::uint64_t ret = 0;
+    for (std::uint64_t s : splits)
+    {
+      ret += s;
+    }
+    return ret;
+  }
+
+  void clear()
+  {
+    *this = modify_stats();
+  }
+
+  modify_stats& operator+=(modify_stats const& rhs)
+  {
+    for (int i = 0; i < MAX_HEIGHT; ++i)
+    {
+      splits[i] += rhs.splits[i];
+    }
+    forced_reinserts += rhs.forced_reinserts;
+    reinserted_entries += rhs.reinserted_entries;
+    erase_orphaned_nodes += rhs.erase_orphaned_nodes;
+    erase_reinserted_entries += rhs.erase_reinserted_entries;
+    root_grows += rhs.root_grows;
+    root_shrinks += rhs.root_shrinks;
+    choose_subtree_comparisons += rhs.choose_subtree_comparisons;
+    max_split_cascade = std::max(max_split_cascade, rhs.max_split_cascade);
+    return *this;
+  }
+};
+
+// per-thread sink of modification statistics; never cleared by the tree
+inline modify_stats& thread_modify_stats()
+{
+  thread_local modify_stats stats;
+  return stats;
+}
+
+// structural events passed to `Config::event_hook::on_modify()`
+enum class modify_event_t
+{
+  // a node at `height` was split; `count` is MAX_ENTRIES + 1
+  split,
+  // overflow of a node at `height` was treated by reinserting `count` entries
+  forced_reinsert,
+  // erase removed an underfull node at `height` with `count` entries left
+  erase_reinsert,
+  // the tree grew; `height` is the new leaf level
+  root_grow,
+  // the tree shrank; `height` is the new leaf level
+  root_shrink,
+};
+
+namespace helper
+{
+// Config::stats if defined, false otherwise
+template <typename Config, typename = void>
+struct config_stats : std::false_type
+{
+};
+template <typename Config>
+struct config_stats<Config, std::void_t<decltype(Config::stats)>>
+    : std::integral_constant<bool, Config::stats>
+{
+};
+
+// whether Config::event_hook is defined
+template <typename Config, typename = void>
+struct config_event_hook : std::false_type
+{
+};
+template <typename Config>
+struct config_event_hook<Config, std::void_t<typename Config::event_hook>>
+    : std::true_type
+{
+};
+}
+
+}
+} // namespace eh rtree
@@ -2,8 +2,13 @@
 
 #include <RTree.hpp>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <memory>
 #include <random>
+#include <sstream>
+#include <string>
 #include <vector>
 
 namespace er = eh::rtree;
@@ -465,4 +470,1947 @@ TEST(RTreeTest, Flatten)
       ASSERT_EQ(search_result[j - min_], j);
     }
   }
-}
\ No newline at end of file
+}
+TEST(RTreeTest, FlattenParallel)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, aabb_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(0, 1000);
+
+  // large enough to be filled by several threads
+  rtree_type rtree;
+  for (int i = 0; i < 100000; ++i)
+  {
+    const point_type p(dist(mt), dist(mt));
+    rtree.insert({ aabb_type(p, p), i });
+  }
+
+  const rtree_type::flatten_result_t sequential = rtree.flatten(1);
+  const rtree_type::flatten_result_t parallel = rtree.flatten(4);
+  ASSERT_EQ(sequential.leaf_level, parallel.leaf_level);
+  ASSERT_EQ(sequential.nodes.size(), parallel.nodes.size());
+  ASSERT_EQ(sequential.children, parallel.children);
+  ASSERT_EQ(sequential.data, parallel.data);
+  ASSERT_EQ(sequential.children_bound.size(), sequential.children.size());
+  ASSERT_EQ(0, std::memcmp(sequential.nodes.data(), parallel.nodes.data(),
+                           sizeof(sequential.nodes[0])
+                               * sequential.nodes.size()));
+  ASSERT_EQ(0, std::memcmp(sequential.children_bound.data(),
+                           parallel.children_bound.data(),
+                           sizeof(aabb_type)
+                               * sequential.children_bound.size()));
+
+  // more threads than children at every level
+  const rtree_type::flatten_result_t many = rtree.flatten(1000);
+  ASSERT_EQ(sequential.children, many.children);
+  ASSERT_EQ(sequential.data, many.data);
+
+  // preorder; every child comes after its parent
+  for (size_t n = 0; n < parallel.nodes.size(); ++n)
+  {
+    if (n != 0)
+    {
+      ASSERT_LT(parallel.nodes[n].parent, n);
+    }
+  }
+
+  // move-only, non-default-constructible data
+  struct move_only_t
+  {
+    std::unique_ptr<int> value;
+    explicit move_only_t(int v)
+        : value(new int(v))
+    {
+    }
+  };
+  using move_rtree_type = er::RTree<aabb_type, aabb_type, move_only_t>;
+  move_rtree_type move_rtree;
+  for (int i = 0; i < 1000; ++i)
+  {
+    const point_type p(dist(mt), dist(mt));
+    move_rtree.insert({ aabb_type(p, p), move_only_t(i) });
+  }
+  const move_rtree_type::flatten_result_t moved = move_rtree.flatten_move(4);
+  ASSERT_EQ(moved.data.size(), move_rtree.size());
+  std::vector<int> moved_values;
+  for (move_only_t const& m : moved.data)
+  {
+    moved_values.push_back(*m.value);
+  }
+  std::sort(moved_values.begin(), moved_values.end());
+  for (int i = 0; i < 1000; ++i)
+  {
+    ASSERT_EQ(moved_values[i], i);
+  }
+}
+TEST(RTreeTest, FlattenLayout)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, aabb_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(0, 1000);
+
+  rtree_type rtree;
+  for (int i = 0; i < 5000; ++i)
+  {
+    const point_type p(dist(mt), dist(mt));
+    rtree.insert({ aabb_type(p, p), i });
+  }
+  const rtree_type::flatten_result_t preorder = rtree.flatten();
+
+  const er::flatten_layout_t layouts[]
+      = { er::flatten_layout_t::breadth_first,
+          er::flatten_layout_t::van_emde_boas,
+          er::flatten_layout_t::leaves_last };
+  for (er::flatten_layout_t layout : layouts)
+  {
+    const rtree_type::flatten_result_t flat = rtree.flatten(layout);
+    ASSERT_EQ(flat.layout, layout);
+    ASSERT_EQ(flat.root, 0);
+    ASSERT_EQ(flat.nodes.size(), preorder.nodes.size());
+    ASSERT_EQ(flat.children.size(), preorder.children.size());
+    ASSERT_EQ(flat.data.size(), preorder.data.size());
+
+    // level of every node, from parent links
+    std::vector<int> level(flat.nodes.size(), -1);
+    level[0] = 0;
+    std::vector<size_t> stack = { 0 };
+    while (!stack.empty())
+    {
+      const size_t n = stack.back();
+      stack.pop_back();
+      if (level[n] == int(flat.leaf_level))
+      {
+        continue;
+      }
+      for (er::size_type c = 0; c < flat.nodes[n].size; ++c)
+      {
+        const er::size_type child = flat.children[flat.nodes[n].offset + c];
+        ASSERT_EQ(flat.nodes[child].parent, n);
+        ASSERT_EQ(level[child], -1);
+        level[child] = level[n] + 1;
+        stack.push_back(child);
+      }
+    }
+    for (size_t n = 1; n < flat.nodes.size(); ++n)
+    {
+      ASSERT_NE(level[n], -1);
+      if (layout == er::flatten_layout_t::breadth_first)
+      {
+        ASSERT_LE(level[n - 1], level[n]);
+      }
+      if (layout == er::flatten_layout_t::leaves_last
+          && level[n - 1] == int(flat.leaf_level))
+      {
+        ASSERT_EQ(level[n], int(flat.leaf_level));
+      }
+    }
+
+    // same query results as preorder layout
+    const rtree_type::flat_view_type view(flat);
+    const rtree_type::flat_view_type preorder_view(preorder);
+    for (int q = 0; q < 50; ++q)
+    {
+      const point_type p(dist(mt), dist(mt));
+      const aabb_type window(p, point_type(p[0] + 50, p[1] + 50));
+      std::vector<int> expected;
+      std::vector<int> result;
+      preorder_view.search_overlap(window,
+                                   [&](aabb_type const&, er::size_type i)
+                                   {
+                                     expected.push_back(preorder_view.data(i));
+                                     return false;
+                                   });
+      view.search_overlap(window,
+                          [&](aabb_type const&, er::size_type i)
+                          {
+                            result.push_back(view.data(i));
+                            return false;
+                          });
+      std::sort(expected.begin(), expected.end());
+      std::sort(result.begin(), result.end());
+      ASSERT_EQ(result, expected);
+    }
+  }
+}
+TEST(RTreeTest, FlatFile)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, aabb_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(0, 1000);
+
+  rtree_type rtree;
+  for (int i = 0; i < 5000; ++i)
+  {
+    const point_type p(dist(mt), dist(mt));
+    rtree.insert({ aabb_type(p, p), i });
+  }
+  const rtree_type::flatten_result_t flat
+      = rtree.flatten(er::flatten_layout_t::breadth_first);
+  const char* path = "flat_file_test.bin";
+  ASSERT_TRUE(er::write_flat_file(path, flat));
+
+  er::flat_file_t<aabb_type, int> file;
+  ASSERT_TRUE(file.open(path));
+  ASSERT_EQ(file.layout(), er::flatten_layout_t::breadth_first);
+  auto const& view = file.view();
+  ASSERT_EQ(view.node_count(), flat.nodes.size());
+  ASSERT_EQ(view.data_count(), flat.data.size());
+  ASSERT_EQ(view.leaf_level(), flat.leaf_level);
+  for (size_t i = 0; i < flat.data.size(); ++i)
+  {
+    ASSERT_EQ(view.data(i), flat.data[i]);
+  }
+  ASSERT_EQ(std::uintptr_t(&view.node(0)) % er::FLAT_FILE_ALIGN, 0);
+
+  const rtree_type::flat_view_type memory_view(flat);
+  for (int q = 0; q < 50; ++q)
+  {
+    const point_type p(dist(mt), dist(mt));
+    const aabb_type window(p, point_type(p[0] + 50, p[1] + 50));
+    std::vector<int> expected;
+    std::vector<int> result;
+    memory_view.search_overlap(window,
+                               [&](aabb_type const&, er::size_type i)
+                               {
+                                 expected.push_back(memory_view.data(i));
+                                 return false;
+                               });
+    view.search_overlap(window,
+                        [&](aabb_type const&, er::size_type i)
+                        {
+                          result.push_back(view.data(i));
+                          return false;
+                        });
+    ASSERT_EQ(result, expected);
+  }
+  file.close();
+  ASSERT_FALSE(file.is_open());
+
+  // different mapped_type
+  er::flat_file_t<aabb_type, double> wrong_type;
+  ASSERT_FALSE(wrong_type.open(path));
+
+  // data_count whose section size wraps around to the real file size
+  {
+    std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+    er::flat_file_header_t h;
+    fs.read(reinterpret_cast<char*>(&h), sizeof(h));
+    h.data_count += std::uint64_t(1) << 62;
+    fs.seekp(0);
+    fs.write(reinterpret_cast<char const*>(&h), sizeof(h));
+  }
+  ASSERT_FALSE(file.open(path));
+  ASSERT_TRUE(er::write_flat_file(path, flat));
+
+  // truncated file
+  {
+    std::ifstream is(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(is)),
+                            std::istreambuf_iterator<char>());
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    os.write(bytes.data(), bytes.size() / 2);
+  }
+  ASSERT_FALSE(file.open(path));
+  std::remove(path);
+  ASSERT_FALSE(file.open(path));
+}
+TEST(RTreeTest, FromFlat)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, aabb_type, int>;
+  using point_rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(0, 1000);
+
+  rtree_type rtree;
+  point_rtree_type point_rtree;
+  for (int i = 0; i < 5000; ++i)
+  {
+    const point_type p(dist(mt), dist(mt));
+    rtree.insert({ aabb_type(p, point_type(p[0] + 1, p[1] + 1)), i });
+    point_rtree.insert({ p, i });
+  }
+  const rtree_type::flatten_result_t original = rtree.flatten();
+
+  // same shape; flattens to the same buffers
+  auto check_same = [&](rtree_type const& rebuilt)
+  {
+    ASSERT_EQ(rebuilt.size(), rtree.size());
+    ASSERT_EQ(rebuilt.leaf_level(), rtree.leaf_level());
+    const rtree_type::flatten_result_t flat = rebuilt.flatten();
+    ASSERT_EQ(flat.children, original.children);
+    ASSERT_EQ(flat.data, original.data);
+    ASSERT_EQ(0, std::memcmp(flat.nodes.data(), original.nodes.data(),
+                             sizeof(flat.nodes[0]) * flat.nodes.size()));
+    ASSERT_EQ(0, std::memcmp(flat.children_bound.data(),
+                             original.children_bound.data(),
+                             sizeof(aabb_type) * flat.children_bound.size()));
+  };
+  check_same(rtree_type::from_flat(rtree.flatten()));
+  check_same(rtree_type::from_flat(
+      rtree.flatten(er::flatten_layout_t::van_emde_boas)));
+
+  // point keys, converted back from stored bounds
+  point_rtree_type rebuilt = point_rtree_type::from_flat(
+      point_rtree.flatten(),
+      [](aabb_type const& bound) { return bound.min_; });
+  ASSERT_EQ(rebuilt.size(), point_rtree.size());
+  auto it = point_rtree.begin();
+  for (auto const& value : rebuilt)
+  {
+    ASSERT_EQ(value.first[0], it->first[0]);
+    ASSERT_EQ(value.first[1], it->first[1]);
+    ASSERT_EQ(value.second, it->second);
+    ++it;
+  }
+
+  // accepts updates again
+  for (int i = 5000; i < 6000; ++i)
+  {
+    rebuilt.insert({ point_type(dist(mt), dist(mt)), i });
+  }
+  for (int i = 0; i < 3000; ++i)
+  {
+    rebuilt.erase(rebuilt.begin());
+  }
+  ASSERT_EQ(rebuilt.size(), 3000);
+
+  ASSERT_TRUE(rtree_type::from_flat(rtree_type().flatten()).empty());
+}
+struct string_serializer
+{
+  void write(std::ostream& os, std::string const& value) const
+  {
+    const std::uint32_t length = value.size();
+    os.write(reinterpret_cast<char const*>(&length), sizeof(length));
+    os.write(value.data(), length);
+  }
+  bool read(std::istream& is, std::string& value) const
+  {
+    std::uint32_t length;
+    if (!is.read(reinterpret_cast<char*>(&length), sizeof(length)))
+    {
+      return false;
+    }
+    value.resize(length);
+    return bool(is.read(&value[0], length));
+  }
+};
+TEST(RTreeTest, SaveLoad)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+  using string_rtree_type = er::RTree<aabb_type, point_type, std::string>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(0, 1000);
+
+  rtree_type rtree;
+  string_rtree_type string_rtree;
+  for (int i = 0; i < 5000; ++i)
+  {
+    const point_type p(dist(mt), dist(mt));
+    rtree.insert({ p, i });
+    string_rtree.insert({ p, std::to_string(i) });
+  }
+
+  std::stringstream stream;
+  ASSERT_TRUE(rtree.save(stream));
+  const std::string bytes = stream.str();
+
+  // same shape; flattens to the same buffers
+  rtree_type loaded;
+  loaded.insert({ point_type(0.0, 0.0), -1 });
+  ASSERT_TRUE(loaded.load(stream));
+  ASSERT_EQ(loaded.size(), rtree.size());
+  ASSERT_EQ(loaded.leaf_level(), rtree.leaf_level());
+  const rtree_type::flatten_result_t expected = rtree.flatten();
+  const rtree_type::flatten_result_t flat = loaded.flatten();
+  ASSERT_EQ(flat.children, expected.children);
+  ASSERT_EQ(flat.data, expected.data);
+  ASSERT_EQ(0, std::memcmp(flat.children_bound.data(),
+                           expected.children_bound.data(),
+                           sizeof(aabb_type) * flat.children_bound.size()));
+
+  // user serializer for mapped_type
+  std::stringstream string_stream;
+  ASSERT_TRUE(string_rtree.save(string_stream, string_serializer()));
+  string_rtree_type string_loaded;
+  ASSERT_TRUE(string_loaded.load(string_stream, string_serializer()));
+  auto it = string_rtree.begin();
+  for (auto const& value : string_loaded)
+  {
+    ASSERT_EQ(value.second, it->second);
+    ++it;
+  }
+
+  // truncated stream
+  std::stringstream truncated(bytes.substr(0, bytes.size() / 2));
+  ASSERT_FALSE(loaded.load(truncated));
+  ASSERT_TRUE(loaded.empty());
+
+  // different mapped_type size
+  std::stringstream wrong(bytes);
+  er::RTree<aabb_type, point_type, double> wrong_type;
+  ASSERT_FALSE(wrong_type.load(wrong));
+
+  // malformed root; `root_size` children of a single leaf of `leaf_size`
+  auto malformed = [&](std::uint32_t root_size, std::uint32_t leaf_size)
+  {
+    er::tree_file_header_t h;
+    std::memcpy(&h, bytes.data(), sizeof(h));
+    h.leaf_level = 1;
+    h.size = root_size * leaf_size;
+    std::stringstream s;
+    er::helper::write_raw(s, h);
+    er::helper::write_raw(s, root_size);
+    for (std::uint32_t c = 0; c < root_size; ++c)
+    {
+      const point_type p(0.0, 0.0);
+      er::helper::write_raw(s, aabb_type(p, p));
+      er::helper::write_raw(s, leaf_size);
+      for (std::uint32_t i = 0; i < leaf_size; ++i)
+      {
+        er::helper::write_raw(s, p);
+        er::helper::write_raw(s, int(i));
+      }
+    }
+    return s;
+  };
+  std::stringstream empty_root = malformed(0, 3);
+  ASSERT_FALSE(loaded.load(empty_root));
+  std::stringstream single_child = malformed(1, 3);
+  ASSERT_FALSE(loaded.load(single_child));
+  std::stringstream two_children = malformed(2, 3);
+  ASSERT_TRUE(loaded.load(two_children));
+  ASSERT_EQ(loaded.size(), 6);
+}
+TEST(RTreeTest, FlattenUpdate)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, aabb_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(0, 1000);
+
+  rtree_type rtree;
+  rtree_type::flatten_result_t flat;
+  int next = 0;
+
+  // first call flattens the whole tree
+  ASSERT_TRUE(rtree.flatten_update(flat).full);
+  ASSERT_TRUE(rtree.flatten_update(flat).ranges.empty());
+  ASSERT_EQ(flat.layout, er::flatten_layout_t::preorder);
+
+  auto check = [&]()
+  {
+    const rtree_type::flatten_result_t fresh = rtree.flatten();
+    const rtree_type::flat_view_type view(flat);
+    const rtree_type::flat_view_type fresh_view(fresh);
+    ASSERT_EQ(flat.leaf_level, fresh.leaf_level);
+    ASSERT_EQ(flat.root, 0);
+    for (int q = 0; q < 50; ++q)
+    {
+      const point_type p(dist(mt), dist(mt));
+      const aabb_type window(p, point_type(p[0] + 100, p[1] + 100));
+      std::vector<int> expected;
+      std::vector<int> result;
+      fresh_view.search_overlap(window,
+                                [&](aabb_type const&, er::size_type i)
+                                {
+                                  expected.push_back(fresh_view.data(i));
+                                  return false;
+                                });
+      view.search_overlap(window,
+                          [&](aabb_type const&, er::size_type i)
+                          {
+                            result.push_back(view.data(i));
+                            return false;
+                          });
+      std::sort(expected.begin(), expected.end());
+      std::sort(result.begin(), result.end());
+      ASSERT_EQ(result, expected);
+    }
+  };
+
+  // grow from a single leaf; root changes on every height increase
+  for (int round = 0; round < 20; ++round)
+  {
+    for (int i = 0; i < 250; ++i)
+    {
+      const point_type p(dist(mt), dist(mt));
+      rtree.insert({ aabb_type(p, p), next++ });
+    }
+    const rtree_type::flatten_update_result_t result
+        = rtree.flatten_update(flat);
+    ASSERT_FALSE(result.full);
+    ASSERT_FALSE(result.ranges.empty());
+    // new nodes appended; subtrees are no longer contiguous
+    ASSERT_EQ(flat.layout, er::flatten_layout_t::unordered);
+    check();
+  }
+
+  // small bursts of inserts and erases
+  for (int round = 0; round < 20; ++round)
+  {
+    for (int i = 0; i < 20; ++i)
+    {
+      const point_type p(dist(mt), dist(mt));
+      rtree.insert({ aabb_type(p, p), next++ });
+      auto it = rtree.begin();
+      std::advance(it, int(dist(mt)) % int(rtree.size()));
+      rtree.erase(it);
+    }
+    const rtree_type::flatten_update_result_t result
+        = rtree.flatten_update(flat);
+    ASSERT_FALSE(result.ranges.empty());
+    for (er::flatten_range_t const& r : result.ranges)
+    {
+      ASSERT_GT(r.bytes, 0);
+    }
+    check();
+  }
+
+  // nothing changed
+  ASSERT_TRUE(rtree.flatten_update(flat).ranges.empty());
+
+  // shrink; eventually rebuilt by garbage
+  bool full = false;
+  while (rtree.size() > 10)
+  {
+    for (int i = 0; i < 200 && rtree.size() > 10; ++i)
+    {
+      rtree.erase(rtree.begin());
+    }
+    full = rtree.flatten_update(flat).full || full;
+    check();
+  }
+  ASSERT_TRUE(full);
+
+  // buffer of another flatten is rebuilt
+  rtree_type::flatten_result_t other = rtree.flatten();
+  ASSERT_TRUE(rtree.flatten_update(other).full);
+  ASSERT_TRUE(rtree.flatten_update(flat).full);
+  ASSERT_EQ(flat.layout, er::flatten_layout_t::preorder);
+
+  rtree.clear();
+  ASSERT_TRUE(rtree.flatten_update(flat).full);
+  check();
+}
+
+TEST(RTreeTest, SearchBatch)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+  std::uniform_real_distribution<double> extent(0, 20);
+
+  rtree_type rtree;
+  std::vector<rtree_type::value_type> original;
+  for (int i = 0; i < 2000; ++i)
+  {
+    point_type p = { dist(mt), dist(mt) };
+    rtree.insert({ p, i });
+    original.push_back({ p, i });
+  }
+
+  std::vector<aabb_type> queries;
+  for (int i = 0; i < 300; ++i)
+  {
+    point_type min_ = { dist(mt), dist(mt) };
+    point_type max_ = { min_[0] + extent(mt), min_[1] + extent(mt) };
+    queries.push_back({ min_, max_ });
+  }
+
+  std::vector<std::vector<int>> found(queries.size());
+  rtree.search_batch(queries.begin(), queries.end(),
+                     [&](er::size_type q, rtree_type::value_type const& value)
+                     {
+                       found[q].push_back(value.second);
+                       return false;
+                     });
+
+  for (int q = 0; q < queries.size(); ++q)
+  {
+    std::vector<int> expected;
+    for (auto const& v : original)
+    {
+      if (er::helper::is_overlap(v.first, queries[q]))
+      {
+        expected.push_back(v.second);
+      }
+    }
+    std::sort(found[q].begin(), found[q].end());
+    ASSERT_EQ(found[q], expected) << "query " << q;
+  }
+}
+
+TEST(RTreeTest, Nearest)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+
+  rtree_type rtree;
+  std::vector<point_type> original;
+  for (int i = 0; i < 2000; ++i)
+  {
+    point_type p = { dist(mt), dist(mt) };
+    rtree.insert({ p, i });
+    original.push_back(p);
+  }
+
+  const er::size_type k = 7;
+  std::vector<point_type> queries;
+  for (int i = 0; i < 200; ++i)
+  {
+    queries.push_back({ dist(mt), dist(mt) });
+  }
+  std::vector<rtree_type::nearest_value_type> batch(queries.size() * k);
+  rtree.nearest_batch(queries.begin(), queries.end(), k, batch.begin(), 4);
+
+  for (int q = 0; q < queries.size(); ++q)
+  {
+    std::vector<double> expected;
+    for (point_type const& p : original)
+    {
+      expected.push_back(er::helper::min_distance(p, queries[q]));
+    }
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<rtree_type::nearest_value_type> result;
+    ASSERT_EQ(rtree.nearest(queries[q], k, std::back_inserter(result)), k);
+    for (int j = 0; j < k; ++j)
+    {
+      ASSERT_EQ(result[j].first, expected[j]);
+      ASSERT_EQ(result[j].first,
+                er::helper::min_distance(result[j].second->first, queries[q]));
+      ASSERT_EQ(batch[q * k + j].first, expected[j]);
+      ASSERT_EQ(batch[q * k + j].second, result[j].second);
+    }
+  }
+
+  // fewer values than k
+  rtree_type small;
+  small.insert({ point_type(0.0, 0.0), 0 });
+  std::vector<rtree_type::nearest_value_type> padded(3);
+  small.nearest_batch(queries.begin(), queries.begin() + 1, 3, padded.begin());
+  ASSERT_EQ(padded[0].second->second, 0);
+  ASSERT_EQ(padded[1].second, rtree_type::const_iterator());
+  ASSERT_EQ(padded[2].second, rtree_type::const_iterator());
+}
+
+TEST(RTreeTest, Join)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_a_type = er::RTree<aabb_type, point_type, int>;
+  using rtree_b_type = er::RTree<aabb_type, aabb_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+  std::uniform_real_distribution<double> extent(0, 5);
+
+  rtree_a_type a;
+  rtree_b_type b;
+  std::vector<point_type> points;
+  std::vector<aabb_type> boxes;
+  for (int i = 0; i < 500; ++i)
+  {
+    point_type p = { dist(mt), dist(mt) };
+    a.insert({ p, i });
+    points.push_back(p);
+  }
+  for (int i = 0; i < 700; ++i)
+  {
+    point_type min_ = { dist(mt), dist(mt) };
+    point_type max_ = { min_[0] + extent(mt), min_[1] + extent(mt) };
+    b.insert({ { min_, max_ }, i });
+    boxes.push_back({ min_, max_ });
+  }
+
+  // closest pairs
+  std::vector<double> expected;
+  for (point_type const& p : points)
+  {
+    for (aabb_type const& box : boxes)
+    {
+      expected.push_back(er::helper::min_distance(p, box));
+    }
+  }
+  std::sort(expected.begin(), expected.end());
+
+  const er::size_type k = 50;
+  std::vector<er::closest_pair_t<rtree_a_type, rtree_b_type>> pairs;
+  ASSERT_EQ(er::closest_pairs(a, b, k, std::back_inserter(pairs)), k);
+  for (int i = 0; i < k; ++i)
+  {
+    ASSERT_EQ(pairs[i].distance, expected[i]);
+    ASSERT_EQ(pairs[i].distance,
+              er::helper::min_distance(pairs[i].first->first,
+                                       pairs[i].second->first));
+  }
+
+  // knn join
+  int joined = 0;
+  er::knn_join(a, b, 5,
+               [&](rtree_a_type::const_iterator it,
+                   std::vector<rtree_b_type::nearest_value_type> const& result)
+               {
+                 std::vector<rtree_b_type::nearest_value_type> nearest;
+                 b.nearest(it->first, 5, std::back_inserter(nearest));
+                 EXPECT_EQ(result.size(), nearest.size());
+                 for (int i = 0; i < nearest.size(); ++i)
+                 {
+                   EXPECT_EQ(result[i].first, nearest[i].first);
+                 }
+                 ++joined;
+                 return false;
+               });
+  ASSERT_EQ(joined, 500);
+
+  // b much shallower than a, fewer values than k in b; stop early
+  rtree_b_type small;
+  std::vector<aabb_type> small_boxes(boxes.begin(), boxes.begin() + 20);
+  for (int i = 0; i < 20; ++i)
+  {
+    small.insert({ small_boxes[i], i });
+  }
+  for (er::size_type small_k : { 3, 30 })
+  {
+    joined = 0;
+    er::knn_join(
+        a, small, small_k,
+        [&](rtree_a_type::const_iterator it,
+            std::vector<rtree_b_type::nearest_value_type> const& result)
+        {
+          std::vector<double> nearest;
+          for (aabb_type const& box : small_boxes)
+          {
+            nearest.push_back(er::helper::min_distance(it->first, box));
+          }
+          std::sort(nearest.begin(), nearest.end());
+          nearest.resize(std::min<er::size_type>(small_k, nearest.size()));
+          EXPECT_EQ(result.size(), nearest.size());
+          for (int i = 0; i < nearest.size(); ++i)
+          {
+            EXPECT_EQ(result[i].first, nearest[i]);
+          }
+          return ++joined == 100;
+        });
+    ASSERT_EQ(joined, 100);
+  }
+}
+
+// distance along x axis only
+struct axis_x_metric
+{
+  template <typename Bound, typename Query>
+  double min_distance(Bound const& bound, Query const& query) const
+  {
+    return er::helper::axis_gap(bound, query, 0);
+  }
+  template <typename Key, typename Query>
+  double distance(Key const& key, Query const& query) const
+  {
+    return er::helper::axis_gap(key, query, 0);
+  }
+};
+
+template <typename TreeType, typename PointType, typename Metric>
+void test_nearest_metric(TreeType const& rtree,
+                         std::vector<PointType> const& points,
+                         PointType const& query,
+                         Metric const& metric)
+{
+  std::vector<double> expected;
+  for (PointType const& p : points)
+  {
+    expected.push_back(metric.distance(p, query));
+  }
+  std::sort(expected.begin(), expected.end());
+
+  std::vector<typename TreeType::nearest_value_type> result;
+  ASSERT_EQ(rtree.nearest(query, 10, std::back_inserter(result), metric), 10);
+  for (int j = 0; j < 10; ++j)
+  {
+    ASSERT_EQ(result[j].first, expected[j]);
+    ASSERT_EQ(result[j].first, metric.distance(result[j].second->first, query));
+  }
+}
+
+TEST(RTreeTest, NearestMetric)
+{
+  using point_type = er::point_t<double, 3>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+
+  rtree_type rtree;
+  std::vector<point_type> points;
+  for (int i = 0; i < 2000; ++i)
+  {
+    point_type p = { dist(mt), dist(mt), dist(mt) };
+    rtree.insert({ p, i });
+    points.push_back(p);
+  }
+
+  for (int i = 0; i < 50; ++i)
+  {
+    point_type query = { dist(mt), dist(mt), dist(mt) };
+    test_nearest_metric(rtree, points, query, er::ManhattanMetric {});
+    test_nearest_metric(rtree, points, query, er::ChebyshevMetric {});
+    test_nearest_metric(rtree, points, query,
+                        er::WeightedEuclideanMetric<double, 3> { 1, 4, 0.25 });
+    test_nearest_metric(rtree, points, query, axis_x_metric {});
+  }
+}
+
+TEST(RTreeTest, NearestApproximate)
+{
+  using point_type = er::point_t<double, 6>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+  auto random_point = [&]()
+  {
+    point_type p;
+    for (int axis = 0; axis < 6; ++axis)
+    {
+      p[axis] = dist(mt);
+    }
+    return p;
+  };
+
+  rtree_type rtree;
+  for (int i = 0; i < 3000; ++i)
+  {
+    rtree.insert({ random_point(), i });
+  }
+
+  const er::size_type k = 5;
+  rtree_type::nearest_buffer_t buffer;
+  for (int i = 0; i < 50; ++i)
+  {
+    const point_type query = random_point();
+
+    std::vector<rtree_type::nearest_value_type> exact;
+    rtree.nearest(query, k, std::back_inserter(exact), er::EuclideanMetric {},
+                  buffer);
+    const er::size_type exact_visits = buffer.visits;
+
+    // within (1 + epsilon) of exact distances
+    rtree_type::nearest_option_t option;
+    option.epsilon = 0.5;
+    std::vector<rtree_type::nearest_value_type> approx;
+    ASSERT_EQ(rtree.nearest_approximate(query, k, std::back_inserter(approx),
+                                        option, er::EuclideanMetric {}, buffer),
+              k);
+    ASSERT_LE(buffer.visits, exact_visits);
+    for (int j = 0; j < k; ++j)
+    {
+      ASSERT_GE(approx[j].first, exact[j].first);
+      ASSERT_LE(approx[j].first, exact[j].first * (1 + option.epsilon));
+    }
+
+    // visit limit
+    option.epsilon = 0;
+    option.max_visits = 3;
+    approx.clear();
+    rtree.nearest_approximate(query, k, std::back_inserter(approx), option,
+                              er::EuclideanMetric {}, buffer);
+    ASSERT_LE(buffer.visits, 3);
+  }
+}
+
+TEST(RTreeTest, QueryRange)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+  std::uniform_real_distribution<double> extent(0, 40);
+
+  rtree_type rtree;
+  for (int i = 0; i < 3000; ++i)
+  {
+    rtree.insert({ { dist(mt), dist(mt) }, i });
+  }
+
+  for (int i = 0; i < 100; ++i)
+  {
+    point_type min_ = { dist(mt), dist(mt) };
+    point_type max_ = { min_[0] + extent(mt), min_[1] + extent(mt) };
+    const aabb_type window(min_, max_);
+
+    auto geometry_filter = [&](aabb_type const& bound) -> int
+    { return er::helper::is_overlap(bound, window) ? 1 : 0; };
+    auto value_filter = [&](rtree_type::value_type const& value)
+    { return er::helper::is_overlap(value.first, window); };
+
+    std::vector<int> expected;
+    rtree.search(geometry_filter,
+                 [&](rtree_type::value_type const& value)
+                 {
+                   if (value_filter(value))
+                   {
+                     expected.push_back(value.second);
+                   }
+                   return false;
+                 });
+
+    std::vector<int> found;
+    rtree_type const& const_rtree = rtree;
+    for (auto const& value :
+         const_rtree.query_range(geometry_filter, value_filter))
+    {
+      found.push_back(value.second);
+    }
+    ASSERT_EQ(found, expected);
+
+    // without value filter, every value of visited leaves
+    auto range = rtree.query_range(geometry_filter);
+    ASSERT_GE(std::distance(range.begin(), range.end()), expected.size());
+  }
+
+  // stop immediately
+  auto stopped = rtree.query_range([](aabb_type const&) { return -1; });
+  ASSERT_EQ(stopped.begin(), stopped.end());
+}
+
+TEST(RTreeTest, QueryToken)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+
+  rtree_type rtree;
+  for (int i = 0; i < 3000; ++i)
+  {
+    rtree.insert({ { dist(mt), dist(mt) }, i });
+  }
+
+  const aabb_type window(point_type(-50.0, -50.0), point_type(50.0, 50.0));
+  auto geometry_filter = [&](aabb_type const& bound) -> int
+  { return er::helper::is_overlap(bound, window) ? 1 : 0; };
+  auto value_filter = [&](rtree_type::value_type const& value)
+  { return er::helper::is_overlap(value.first, window); };
+
+  std::vector<int> expected;
+  for (auto const& value : rtree.query_range(geometry_filter, value_filter))
+  {
+    expected.push_back(value.second);
+  }
+
+  // pages of 100 values, resumed from encoded token
+  std::vector<int> paged;
+  std::string token;
+  bool first_page = true;
+  while (true)
+  {
+    auto range = rtree.query_range(geometry_filter, value_filter);
+    auto it = range.begin();
+    if (!first_page)
+    {
+      er::query_token_t decoded;
+      ASSERT_TRUE(decoded.decode(token));
+      ASSERT_TRUE(rtree.resume_query(decoded, it));
+    }
+    first_page = false;
+    for (int i = 0; i < 100 && it != range.end(); ++i, ++it)
+    {
+      paged.push_back(it->second);
+    }
+    token = rtree.query_token(it).encode();
+    if (it == range.end())
+    {
+      break;
+    }
+  }
+  ASSERT_EQ(paged, expected);
+
+  // stale token
+  auto range = rtree.query_range(geometry_filter, value_filter);
+  auto it = range.begin();
+  er::query_token_t saved = rtree.query_token(it);
+  rtree.insert({ { 0.0, 0.0 }, 3000 });
+  ASSERT_FALSE(rtree.resume_query(saved, it));
+
+  // const tree resumes const iterators
+  rtree_type const& crtree = rtree;
+  auto crange = crtree.query_range(geometry_filter, value_filter);
+  auto cit = crange.begin();
+  ++cit;
+  const er::query_token_t csaved = crtree.query_token(cit);
+  auto cresumed = crange.begin();
+  ASSERT_TRUE(crtree.resume_query(csaved, cresumed));
+  ASSERT_TRUE(cresumed == cit);
+
+  // same modifications on another tree; tokens do not match
+  rtree_type a;
+  rtree_type b;
+  a.insert({ { 0.0, 0.0 }, 0 });
+  b.insert({ { 0.0, 0.0 }, 0 });
+  ASSERT_NE(a.epoch(), b.epoch());
+  auto a_range = a.query_range(geometry_filter, value_filter);
+  auto b_range = b.query_range(geometry_filter, value_filter);
+  auto b_it = b_range.begin();
+  ASSERT_FALSE(b.resume_query(a.query_token(a_range.begin()), b_it));
+
+  er::query_token_t malformed;
+  ASSERT_FALSE(malformed.decode(std::string("\xff", 1)));
+}
+
+TEST(RTreeTest, QueryInto)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+
+  rtree_type rtree;
+  for (int i = 0; i < 3000; ++i)
+  {
+    rtree.insert({ { dist(mt), dist(mt) }, i });
+  }
+
+  const aabb_type window(point_type(-30.0, -30.0), point_type(30.0, 30.0));
+  std::vector<int> expected;
+  for (auto const& value : rtree)
+  {
+    if (er::helper::is_overlap(value.first, window))
+    {
+      expected.push_back(value.second);
+    }
+  }
+  std::sort(expected.begin(), expected.end());
+
+  std::vector<int> mapped(rtree.size());
+  auto result = rtree.query_into(window, mapped.data(), mapped.size());
+  ASSERT_FALSE(result.truncated);
+  ASSERT_EQ(result.count, expected.size());
+  mapped.resize(result.count);
+  std::sort(mapped.begin(), mapped.end());
+  ASSERT_EQ(mapped, expected);
+
+  // key column matches mapped column
+  std::vector<point_type> keys(expected.size());
+  mapped.assign(expected.size(), -1);
+  result = rtree.query_into(window, keys.data(), mapped.data(), keys.size());
+  ASSERT_FALSE(result.truncated);
+  for (size_t i = 0; i < result.count; ++i)
+  {
+    ASSERT_TRUE(er::helper::is_overlap(keys[i], window));
+  }
+
+  // truncated output
+  std::vector<rtree_type::value_type> values(
+      expected.size() / 2, rtree_type::value_type({ 0.0, 0.0 }, -1));
+  result = rtree.query_into(window, values.data(), values.size());
+  ASSERT_TRUE(result.truncated);
+  ASSERT_EQ(result.count, values.size());
+  for (auto const& value : values)
+  {
+    ASSERT_TRUE(er::helper::is_overlap(value.first, window));
+  }
+}
+
+TEST(RTreeTest, SearchLimit)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+
+  rtree_type rtree;
+  for (int i = 0; i < 3000; ++i)
+  {
+    rtree.insert({ { dist(mt), dist(mt) }, i });
+  }
+  auto accept_all = [](aabb_type const&) { return 1; };
+
+  // no limit; complete
+  rtree_type::search_limit_t limit;
+  size_t count = 0;
+  ASSERT_TRUE(rtree.search(
+      accept_all, [&](rtree_type::value_type const&)
+      { return ++count, false; }, limit));
+  ASSERT_EQ(count, 3000);
+
+  // result limit
+  limit.max_results = 100;
+  count = 0;
+  ASSERT_FALSE(rtree.search(
+      accept_all, [&](rtree_type::value_type&)
+      { return ++count, false; }, limit));
+  ASSERT_EQ(count, 100);
+
+  // exactly as many values as the limit; complete
+  limit.max_results = 3000;
+  count = 0;
+  ASSERT_TRUE(rtree.search(
+      accept_all, [&](rtree_type::value_type const&)
+      { return ++count, false; }, limit));
+  ASSERT_EQ(count, 3000);
+
+  // same values as plain search()
+  const aabb_type window({ -50, -50 }, { 50, 50 });
+  auto in_window = [&](aabb_type const& bound)
+  { return er::helper::is_overlap(bound, window) ? 1 : 0; };
+  size_t passed = 0;
+  rtree.search(in_window, [&](rtree_type::value_type const&)
+               { return ++passed, false; });
+  limit.max_results = passed;
+  count = 0;
+  ASSERT_TRUE(rtree.search(
+      in_window, [&](rtree_type::value_type const&)
+      { return ++count, false; }, limit));
+  ASSERT_EQ(count, passed);
+
+  // only values accepted by the value filter are counted
+  auto value_in_window = [&](rtree_type::value_type const& value)
+  { return er::helper::is_overlap(window, value.first); };
+  size_t hits = 0;
+  for (auto const& value : rtree)
+  {
+    hits += value_in_window(value) ? 1 : 0;
+  }
+  limit.max_results = hits;
+  count = 0;
+  ASSERT_TRUE(rtree.search(
+      in_window, value_in_window, [&](rtree_type::value_type const&)
+      { return ++count, false; }, limit));
+  ASSERT_EQ(count, hits);
+  limit.max_results = hits - 1;
+  count = 0;
+  ASSERT_FALSE(rtree.search(
+      in_window, value_in_window, [&](rtree_type::value_type const&)
+      { return ++count, false; }, limit));
+  ASSERT_EQ(count, hits - 1);
+
+  // node limit
+  limit = rtree_type::search_limit_t();
+  limit.max_nodes = 3;
+  rtree_type const& crtree = rtree;
+  count = 0;
+  ASSERT_FALSE(crtree.search(
+      accept_all, [&](rtree_type::value_type const&)
+      { return ++count, false; }, limit));
+  ASSERT_LE(count, 3 * rtree_type::MAX_ENTRIES);
+
+  // deadline already passed
+  limit = rtree_type::search_limit_t();
+  limit.deadline = std::chrono::steady_clock::now();
+  limit.check_interval = 1;
+  count = 0;
+  ASSERT_FALSE(rtree.search(
+      accept_all, [&](rtree_type::value_type const&)
+      { return ++count, false; }, limit));
+  ASSERT_LT(count, 3000);
+}
+
+struct stats_config : er::DefaultConfig
+{
+  constexpr static bool stats = true;
+};
+
+TEST(RTreeTest, QueryStats)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int, stats_config>;
+  using plain_rtree_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+
+  rtree_type rtree;
+  plain_rtree_type plain_rtree;
+  for (int i = 0; i < 3000; ++i)
+  {
+    const point_type p(dist(mt), dist(mt));
+    rtree.insert({ p, i });
+    plain_rtree.insert({ p, i });
+  }
+
+  const aabb_type window(point_type(-30.0, -30.0), point_type(30.0, 30.0));
+  auto geometry_filter = [&](aabb_type const& bound)
+  { return er::helper::is_overlap(bound, window) ? 1 : 0; };
+
+  er::query_stats& stats = er::thread_query_stats();
+
+  // disabled by default
+  stats.clear();
+  plain_rtree.search(geometry_filter,
+                     [](plain_rtree_type::value_type const&) { return false; });
+  ASSERT_EQ(stats.leaves_visited, 0);
+
+  stats.clear();
+  rtree.search(geometry_filter,
+               [](rtree_type::value_type const&) { return false; });
+  const er::query_stats search_stats = stats;
+  ASSERT_GT(search_stats.nodes_visited, 0);
+  ASSERT_GT(search_stats.leaves_visited, 0);
+  ASSERT_LT(search_stats.leaves_visited, rtree.size());
+  ASSERT_GT(search_stats.entries_scanned, 0);
+  ASSERT_EQ(search_stats.results, 0);
+  ASSERT_GE(search_stats.filter_calls,
+            search_stats.nodes_visited + search_stats.leaves_visited - 1);
+  ASSERT_GT(search_stats.max_prune_depth, 0);
+
+  // search_iterator visits the same nodes
+  stats.clear();
+  size_t count = 0;
+  rtree.search_iterator(geometry_filter,
+                        [&](rtree_type::iterator) { return ++count, false; });
+  ASSERT_EQ(stats.leaves_visited, search_stats.leaves_visited);
+  ASSERT_EQ(stats.nodes_visited, search_stats.nodes_visited);
+  ASSERT_EQ(count, search_stats.entries_scanned);
+
+  size_t hits = 0;
+  for (auto const& value : rtree)
+  {
+    hits += er::helper::is_overlap(window, value.first) ? 1 : 0;
+  }
+
+  // query_range visits the same nodes; only yielded values are results
+  stats.clear();
+  count = 0;
+  for (auto const& value :
+       rtree.query_range(geometry_filter, [&](rtree_type::value_type const& v)
+                         { return er::helper::is_overlap(window, v.first); }))
+  {
+    (void)value;
+    ++count;
+  }
+  ASSERT_EQ(count, hits);
+  ASSERT_EQ(stats.results, hits);
+  ASSERT_EQ(stats.leaves_visited, search_stats.leaves_visited);
+  ASSERT_EQ(stats.nodes_visited, search_stats.nodes_visited);
+  ASSERT_EQ(stats.entries_scanned, search_stats.entries_scanned);
+  ASSERT_EQ(stats.filter_calls, search_stats.filter_calls);
+
+  // limited search counts values passed to the data functor
+  stats.clear();
+  count = 0;
+  rtree.search(geometry_filter, [&](rtree_type::value_type const&)
+               { return ++count, false; }, rtree_type::search_limit_t());
+  ASSERT_EQ(stats.results, count);
+  ASSERT_EQ(stats.leaves_visited, search_stats.leaves_visited);
+  stats.clear();
+  rtree.search(
+      geometry_filter, [&](rtree_type::value_type const& v)
+      { return er::helper::is_overlap(window, v.first); },
+      [](rtree_type::value_type const&) { return false; },
+      rtree_type::search_limit_t());
+  ASSERT_EQ(stats.results, hits);
+
+  // search_batch of a single window
+  stats.clear();
+  count = 0;
+  const std::vector<aabb_type> windows = { window };
+  rtree.search_batch(windows.begin(), windows.end(),
+                     [&](er::size_type, rtree_type::value_type const&)
+                     { return ++count, false; });
+  ASSERT_EQ(count, hits);
+  ASSERT_EQ(stats.results, hits);
+  ASSERT_EQ(stats.leaves_visited, search_stats.leaves_visited);
+  ASSERT_EQ(stats.nodes_visited, search_stats.nodes_visited);
+
+  stats.clear();
+  std::vector<rtree_type::nearest_value_type> nearest;
+  rtree.nearest(point_type(0.0, 0.0), 10, std::back_inserter(nearest));
+  ASSERT_EQ(stats.results, 10);
+  ASSERT_GT(stats.leaves_visited, 0);
+  ASSERT_GE(stats.entries_scanned, 10);
+
+  // nearest_batch on worker threads adds into the caller's sink
+  std::vector<point_type> batch_points;
+  for (int i = 0; i < 1000; ++i)
+  {
+    batch_points.push_back(point_type(dist(mt), dist(mt)));
+  }
+  std::vector<rtree_type::nearest_value_type> batch_out(batch_points.size()
+                                                        * 5);
+  stats.clear();
+  rtree.nearest_batch(batch_points.begin(), batch_points.end(), 5,
+                      batch_out.begin(), 1);
+  const er::query_stats sequential_stats = stats;
+  ASSERT_EQ(sequential_stats.results, 5000);
+  stats.clear();
+  rtree.nearest_batch(batch_points.begin(), batch_points.end(), 5,
+                      batch_out.begin(), 4);
+  ASSERT_EQ(stats.results, 5000);
+  ASSERT_EQ(stats.nodes_visited, sequential_stats.nodes_visited);
+  ASSERT_EQ(stats.leaves_visited, sequential_stats.leaves_visited);
+  ASSERT_EQ(stats.entries_scanned, sequential_stats.entries_scanned);
+}
+
+struct modify_event_counter
+{
+  static int splits;
+  static int root_grows;
+  static void on_modify(er::modify_event_t event, int height, er::size_type)
+  {
+    if (event == er::modify_event_t::split)
+    {
+      ++splits;
+    }
+    else if (event == er::modify_event_t::root_grow)
+    {
+      ++root_grows;
+    }
+  }
+};
+int modify_event_counter::splits = 0;
+int modify_event_counter::root_grows = 0;
+
+struct event_hook_config : er::DefaultConfig
+{
+  using event_hook = modify_event_counter;
+};
+
+TEST(RTreeTest, ModifyStats)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int, stats_config>;
+  using hook_rtree_type
+      = er::RTree<aabb_type, point_type, int, event_hook_config>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+
+  er::modify_stats& stats = er::thread_modify_stats();
+  stats.clear();
+
+  rtree_type rtree;
+  hook_rtree_type hook_rtree;
+  for (int i = 0; i < 3000; ++i)
+  {
+    const point_type p(dist(mt), dist(mt));
+    rtree.insert({ p, i });
+    hook_rtree.insert({ p, i });
+  }
+  ASSERT_GT(stats.splits[0], 0);
+  ASSERT_GT(stats.forced_reinserts, 0);
+  ASSERT_EQ(stats.reinserted_entries,
+            stats.forced_reinserts * stats_config::REINSERT_COUNT);
+  ASSERT_EQ(stats.root_grows, rtree.leaf_level());
+  ASSERT_GT(stats.choose_subtree_comparisons, 0);
+  ASSERT_GE(stats.max_split_cascade, 1);
+
+  // the hook sees the same structure; stats are not collected without
+  // Config::stats
+  ASSERT_EQ(modify_event_counter::root_grows, hook_rtree.leaf_level());
+  ASSERT_GT(modify_event_counter::splits, 0);
+
+  // erase everything
+  while (!rtree.empty())
+  {
+    rtree.erase(rtree.begin());
+  }
+  ASSERT_EQ(stats.root_shrinks, stats.root_grows);
+  ASSERT_GT(stats.erase_orphaned_nodes, 0);
+}
+
+TEST(RTreeTest, QualityReport)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, aabb_type, int>;
+
+  // coverage of [0,2]x[0,2], [1,3]x[0,2], [5,6]x[5,6]
+  using box_type = er::helper::quality_box_t<2>;
+  const box_type boxes[3] = { { { 0, 0 }, { 2, 2 } },
+                              { { 1, 0 }, { 3, 2 } },
+                              { { 5, 5 }, { 6, 6 } } };
+  std::vector<box_type const*> pointers = { &boxes[0], &boxes[1], &boxes[2] };
+  ASSERT_DOUBLE_EQ(er::helper::coverage_area(pointers, 1), 7.0);
+  ASSERT_DOUBLE_EQ(er::helper::coverage_area(pointers, 2), 2.0);
+  ASSERT_DOUBLE_EQ(er::helper::coverage_area(pointers, 3), 0.0);
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+  std::uniform_real_distribution<double> extent(0.1, 5);
+
+  rtree_type rtree;
+  for (int i = 0; i < 3000; ++i)
+  {
+    const double x = dist(mt);
+    const double y = dist(mt);
+    const point_type p(x, y);
+    const point_type q(x + extent(mt), y + extent(mt));
+    rtree.insert({ aabb_type(p, q), i });
+  }
+
+  const er::quality_report_t report = rtree.quality_report();
+  ASSERT_EQ(report.levels.size(), rtree.leaf_level() + 1);
+  ASSERT_EQ(report.levels[0].node_count, 1);
+
+  size_t leaf_count = 0;
+  for (auto li = rtree.leaf_begin(); li != rtree.leaf_end(); ++li)
+  {
+    ++leaf_count;
+  }
+  ASSERT_EQ(report.levels.back().node_count, leaf_count);
+
+  for (size_t l = 0; l < report.levels.size(); ++l)
+  {
+    er::level_quality_t const& level = report.levels[l];
+    ASSERT_GT(level.average_fill, 0.0);
+    ASSERT_LE(level.average_fill, 1.0);
+    ASSERT_LE(level.min_fill, level.average_fill);
+    if (l > 0)
+    {
+      ASSERT_GE(level.min_fill, double(rtree_type::MIN_ENTRIES)
+                                    / double(rtree_type::MAX_ENTRIES));
+    }
+    ASSERT_GE(level.overlap, 0.0);
+    ASSERT_GE(level.pairwise_overlap, level.overlap - 1e-6);
+    ASSERT_GE(level.dead_space, -1e-6);
+    ASSERT_GT(level.margin, 0.0);
+
+    size_t histogram = 0;
+    for (int b = 0; b < er::level_quality_t::ASPECT_BUCKETS; ++b)
+    {
+      histogram += level.aspect_ratio[b];
+    }
+    ASSERT_EQ(histogram, level.node_count);
+  }
+}
+TEST(RTreeTest, FlatView)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, aabb_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(0, 100);
+  std::uniform_real_distribution<double> extent(0, 2);
+
+  rtree_type rtree;
+  std::vector<aabb_type> original;
+  for (int i = 0; i < 3000; ++i)
+  {
+    const double x = dist(mt);
+    const double y = dist(mt);
+    const aabb_type box(point_type(x, y),
+                        point_type(x + extent(mt), y + extent(mt)));
+    rtree.insert({ box, i });
+    original.push_back(box);
+  }
+  const rtree_type::flatten_result_t flat = rtree.flatten();
+  const rtree_type::flat_view_type view(flat);
+  ASSERT_EQ(view.data_count(), 3000);
+
+  for (int q = 0; q < 100; ++q)
+  {
+    const double x = dist(mt);
+    const double y = dist(mt);
+
+    // window
+    const aabb_type window(point_type(x, y), point_type(x + 10, y + 10));
+    std::vector<int> expected;
+    for (int i = 0; i < 3000; ++i)
+    {
+      if (er::helper::is_overlap(original[i], window))
+      {
+        expected.push_back(i);
+      }
+    }
+    std::vector<int> result;
+    ASSERT_TRUE(view.search_overlap(
+        window,
+        [&](aabb_type const&, er::size_type data_index)
+        {
+          result.push_back(view.data(data_index));
+          return false;
+        }));
+    std::sort(result.begin(), result.end());
+    ASSERT_EQ(result, expected);
+
+    // nearest
+    const point_type point(x, y);
+    std::vector<double> expected_distances;
+    for (aabb_type const& box : original)
+    {
+      expected_distances.push_back(er::helper::min_distance(box, point));
+    }
+    std::sort(expected_distances.begin(), expected_distances.end());
+    er::size_type indices[5];
+    double distances[5];
+    ASSERT_EQ(view.nearest(point, 5, indices, distances), 5);
+    for (int j = 0; j < 5; ++j)
+    {
+      ASSERT_EQ(distances[j], expected_distances[j]);
+      ASSERT_EQ(distances[j],
+                er::helper::min_distance(original[view.data(indices[j])],
+                                         point));
+    }
+
+    // ray along +x from the left border
+    const point_type origin(-1.0, y);
+    const point_type direction(1.0, 0.0);
+    std::vector<int> hits;
+    view.raycast(origin, direction, 1000.0,
+                 [&](double, aabb_type const&, er::size_type data_index)
+                 {
+                   hits.push_back(view.data(data_index));
+                   return false;
+                 });
+    std::vector<int> expected_hits;
+    double first_t = 1e9;
+    for (int i = 0; i < 3000; ++i)
+    {
+      if (original[i].min_[1] <= y && y <= original[i].max_[1])
+      {
+        expected_hits.push_back(i);
+        first_t = std::min(first_t, original[i].min_[0] + 1.0);
+      }
+    }
+    std::sort(hits.begin(), hits.end());
+    ASSERT_EQ(hits, expected_hits);
+
+    er::size_type first;
+    double t;
+    ASSERT_EQ(view.raycast_first(origin, direction, 1000.0, first, t),
+              !expected_hits.empty());
+    if (!expected_hits.empty())
+    {
+      ASSERT_DOUBLE_EQ(t, first_t);
+    }
+  }
+}
+
+TEST(RTreeTest, StaticRTree)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int>;
+  using static_type = er::static_rtree<aabb_type, point_type, int, 8>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-100, 100);
+
+  std::vector<std::pair<point_type, int>> values;
+  for (int i = 0; i < 5000; ++i)
+  {
+    values.push_back({ point_type(dist(mt), dist(mt)), i });
+  }
+  const rtree_type rtree(values.begin(), values.end());
+  const static_type packed(values.begin(), values.end());
+  ASSERT_EQ(packed.size(), values.size());
+
+  // every node but the last one of each level is full
+  ASSERT_EQ(packed.node_count(0), 1);
+  er::size_type count = packed.size();
+  for (int level = packed.leaf_level(); level >= 0; --level)
+  {
+    count = (count + 7) / 8;
+    ASSERT_EQ(packed.node_count(level), count);
+  }
+
+  for (int q = 0; q < 100; ++q)
+  {
+    const point_type p(dist(mt), dist(mt));
+    const aabb_type window(p, point_type(p[0] + 20, p[1] + 20));
+    std::vector<int> expected;
+    std::vector<int> result;
+    rtree.search([&](aabb_type const& bound)
+                 { return er::helper::is_overlap(bound, window) ? 1 : 0; },
+                 [&](rtree_type::value_type const& value)
+                 {
+                   if (er::helper::is_overlap(window, value.first))
+                   {
+                     expected.push_back(value.second);
+                   }
+                   return false;
+                 });
+    packed.search([&](aabb_type const& bound)
+                  { return er::helper::is_overlap(bound, window) ? 1 : 0; },
+                  [&](static_type::value_type const& value)
+                  {
+                    if (er::helper::is_overlap(window, value.first))
+                    {
+                      result.push_back(value.second);
+                    }
+                    return false;
+                  });
+    std::sort(expected.begin(), expected.end());
+    std::sort(result.begin(), result.end());
+    ASSERT_EQ(result, expected);
+
+    const er::size_type k = 7;
+    std::vector<rtree_type::nearest_value_type> expected_nearest;
+    std::vector<static_type::nearest_value_type> result_nearest;
+    rtree.nearest(p, k, std::back_inserter(expected_nearest));
+    ASSERT_EQ(packed.nearest(p, k, std::back_inserter(result_nearest)), k);
+    for (er::size_type j = 0; j < k; ++j)
+    {
+      ASSERT_EQ(result_nearest[j].first, expected_nearest[j].first);
+      ASSERT_EQ(result_nearest[j].first,
+                er::helper::min_distance(result_nearest[j].second->first, p));
+    }
+  }
+
+  // empty and single value
+  const static_type empty;
+  ASSERT_TRUE(empty.empty());
+  std::vector<static_type::nearest_value_type> none;
+  ASSERT_EQ(empty.nearest(point_type(0.0, 0.0), 3, std::back_inserter(none)),
+            0);
+  const static_type single(values.begin(), values.begin() + 1);
+  ASSERT_EQ(single.leaf_level(), 0);
+  ASSERT_EQ(single.nearest(point_type(0.0, 0.0), 3, std::back_inserter(none)),
+            1);
+}
+
+TEST(RTreeTest, BulkLoad)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, aabb_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(0, 1000);
+  std::uniform_real_distribution<double> length(0, 300);
+
+  // long thin boxes along both axes, and points
+  std::vector<rtree_type::value_type> values;
+  for (int i = 0; i < 3000; ++i)
+  {
+    const point_type p(dist(mt), dist(mt));
+    point_type q = p;
+    if (i % 3 != 2)
+    {
+      q[i % 3] += length(mt);
+    }
+    values.push_back({ aabb_type(p, q), i });
+  }
+
+  auto check = [&](rtree_type& rtree, er::size_type count)
+  {
+    ASSERT_EQ(rtree.size(), count);
+    for (int level = 0; level < rtree.leaf_level(); ++level)
+    {
+      for (auto ni = rtree.node_begin(level); ni != rtree.node_end(level); ++ni)
+      {
+        if (level != 0)
+        {
+          ASSERT_GE(ni->size(), rtree_type::MIN_ENTRIES);
+        }
+        ASSERT_LE(ni->size(), rtree_type::MAX_ENTRIES);
+        for (auto& c : **ni)
+        {
+          ASSERT_EQ(c.second->parent(), *ni);
+          const aabb_type b = level + 1 == rtree.leaf_level()
+                                  ? c.second->as_leaf()->calculate_bound()
+                                  : c.second->as_node()->calculate_bound();
+          for (int axis = 0; axis < 2; ++axis)
+          {
+            ASSERT_EQ(er::helper::min_point(c.first, axis),
+                      er::helper::min_point(b, axis));
+            ASSERT_EQ(er::helper::max_point(c.first, axis),
+                      er::helper::max_point(b, axis));
+          }
+        }
+      }
+    }
+    for (auto ni = rtree.leaf_begin(); ni != rtree.leaf_end(); ++ni)
+    {
+      if (rtree.leaf_level() != 0)
+      {
+        ASSERT_GE(ni->size(), rtree_type::MIN_ENTRIES);
+      }
+      ASSERT_LE(ni->size(), rtree_type::MAX_ENTRIES);
+    }
+  };
+  auto check_search = [&](rtree_type& rtree)
+  {
+    for (int q = 0; q < 50; ++q)
+    {
+      const point_type p(dist(mt), dist(mt));
+      const aabb_type window(p, point_type(p[0] + 30, p[1] + 30));
+      std::vector<int> expected;
+      std::vector<int> result;
+      for (auto const& v : values)
+      {
+        if (er::helper::is_overlap(v.first, window))
+        {
+          expected.push_back(v.second);
+        }
+      }
+      rtree.search([&](aabb_type const& bound)
+                   { return er::helper::is_overlap(bound, window) ? 1 : 0; },
+                   [&](rtree_type::value_type const& value)
+                   {
+                     if (er::helper::is_overlap(value.first, window))
+                     {
+                       result.push_back(value.second);
+                     }
+                     return false;
+                   });
+      std::sort(result.begin(), result.end());
+      ASSERT_EQ(result, expected);
+    }
+  };
+
+  rtree_type hilbert;
+  hilbert.bulk_load(values.begin(), values.end());
+  check(hilbert, values.size());
+  check_search(hilbert);
+
+  rtree_type prtree;
+  prtree.bulk_load<er::PRTreeBulkLoad>(values.begin(), values.end());
+  check(prtree, values.size());
+  check_search(prtree);
+
+  // small inputs
+  for (er::size_type n : { 0, 1, 8, 9, 12, 65 })
+  {
+    rtree_type small;
+    small.bulk_load<er::PRTreeBulkLoad>(values.begin(), values.begin() + n);
+    check(small, n);
+  }
+
+  // reload from its own values, then update as usual
+  prtree.bulk_load<er::PRTreeBulkLoad>(
+      std::make_move_iterator(prtree.begin()),
+      std::make_move_iterator(prtree.end()));
+  check(prtree, values.size());
+  for (int i = 0; i < 500; ++i)
+  {
+    prtree.erase(prtree.begin());
+    const point_type p(dist(mt), dist(mt));
+    prtree.insert({ aabb_type(p, p), int(values.size()) + i });
+  }
+  check(prtree, values.size());
+}
+
+struct hilbert_config : er::DefaultConfig
+{
+  using insert_algorithm = er::HilbertInsert<>;
+};
+
+TEST(RTreeTest, HilbertInsert)
+{
+  using point_type = er::point_t<double, 2>;
+  using aabb_type = er::aabb_t<point_type>;
+  using rtree_type = er::RTree<aabb_type, point_type, int, hilbert_config>;
+  using rstar_type = er::RTree<aabb_type, point_type, int>;
+
+  std::mt19937 mt(std::random_device {}());
+  std::uniform_real_distribution<double> dist(-1000, 1000);
+
+  auto check = [&](rtree_type const& rtree)
+  {
+    for (int level = 0; level < rtree.leaf_level(); ++level)
+    {
+      for (auto ni = rtree.node_begin(level); ni != rtree.node_end(level); ++ni)
+      {
+        if (level != 0)
+        {
+          ASSERT_GE((*ni)->size(), rtree_type::MIN_ENTRIES);
+        }
+        ASSERT_LE((*ni)->size(), rtree_type::MAX_ENTRIES);
+        for (auto const& c : **ni)
+        {
+          ASSERT_EQ(c.second->parent(), *ni);
+          const aabb_type b = level + 1 == rtree.leaf_level()
+                                  ? c.second->as_leaf()->calculate_bound()
+                                  : c.second->as_node()->calculate_bound();
+          for (int axis = 0; axis < 2; ++axis)
+          {
+            ASSERT_EQ(er::helper::min_point(c.first, axis),
+                      er::helper::min_point(b, axis));
+            ASSERT_EQ(er::helper::max_point(c.first, axis),
+                      er::helper::max_point(b, axis));
+          }
+        }
+      }
+    }
+    for (auto ni = rtree.leaf_begin(); ni != rtree.leaf_end(); ++ni)
+    {
+      if (rtree.leaf_level() != 0)
+      {
+        ASSERT_GE((*ni)->size(), rtree_type::MIN_ENTRIES);
+      }
+      ASSERT_LE((*ni)->size(), rtree_type::MAX_ENTRIES);
+    }
+    // values are in Hilbert order across leaves
+    std::uint64_t last = 0;
+    for (auto const& value : rtree)
+    {
+      const std::uint64_t h = er::HilbertInsert<>::hilbert_value(value.first);
+      ASSERT_LE(last, h);
+      last = h;
+    }
+  };
+
+  rtree_type rtree;
+  rstar_type rstar;
+  std::vector<point_type> points;
+  for (int i = 0; i < 5000; ++i)
+  {
+    points.push_back(point_type(dist(mt), dist(mt)));
+    rtree.insert({ points.back(), i });
+    rstar.insert({ points.back(), i });
+    if (i % 500 == 0)
+    {
+      check(rtree);
+    }
+  }
+  check(rtree);
+  ASSERT_EQ(rtree.size(), points.size());
+
+  // deferred splitting fills nodes better than R*-Tree
+  const double hilbert_fill = rtree.quality_report().levels.back().average_fill;
+  const double rstar_fill = rstar.quality_report().levels.back().average_fill;
+  ASSERT_GT(hilbert_fill, rstar_fill);
+  ASSERT_GT(hilbert_fill, 0.8);
+
+  // erase half of the values
+  std::vector<bool> erased(points.size(), false);
+  for (int i = 0; i < 2500; ++i)
+  {
+    auto it = rtree.begin();
+    std::advance(it, int(dist(mt) + 1000) % int(rtree.size()));
+    erased[it->second] = true;
+    rtree.erase(it);
+    if (i % 250 == 0)
+    {
+      check(rtree);
+    }
+  }
+  check(rtree);
+  ASSERT_EQ(rtree.size(), 2500);
+
+  for (int q = 0; q < 50; ++q)
+  {
+    const point_type p(dist(mt), dist(mt));
+    const aabb_type window(p, point_type(p[0] + 100, p[1] + 100));
+    std::vector<int> expected;
+    std::vector<int> result;
+    for (int i = 0; i < int(points.size()); ++i)
+    {
+      if (!erased[i] && er::helper::is_overlap(window, points[i]))
+      {
+        expected.push_back(i);
+      }
+    }
+    rtree.search([&](aabb_type const& bound)
+                 { return er::helper::is_overlap(bound, window) ? 1 : 0; },
+                 [&](rtree_type::value_type const& value)
+                 {
+                   if (er::helper::is_overlap(window, value.first))
+                   {
+                     result.push_back(value.second);
+                   }
+                   return false;
+                 });
+    std::sort(result.begin(), result.end());
+    ASSERT_EQ(result, expected);
+  }
+
+  // incremental flatten follows redistribution between siblings
+  rtree_type::flatten_result_t flat;
+  rtree.flatten_update(flat);
+  int next = int(points.size());
+  for (int round = 0; round < 40; ++round)
+  {
+    for (int i = 0; i < 50; ++i)
+    {
+      const point_type p(dist(mt), dist(mt));
+      rtree.insert({ p, next++ });
+      auto it = rtree.begin();
+      std::advance(it, int(dist(mt) + 1000) % int(rtree.size()));
+      rtree.erase(it);
+    }
+    rtree.flatten_update(flat);
+    const rtree_type::flat_view_type view(flat);
+    for (int q = 0; q < 20; ++q)
+    {
+      const point_type p(dist(mt), dist(mt));
+      const aabb_type window(p, point_type(p[0] + 300, p[1] + 300));
+      std::vector<int> expected;
+      std::vector<int> result;
+      for (auto const& value : rtree)
+      {
+        if (er::helper::is_overlap(window, value.first))
+        {
+          expected.push_back(value.second);
+        }
+      }
+      view.search_overlap(window,
+                          [&](aabb_type const&, er::size_type i)
+                          {
+                            result.push_back(view.data(i));
+                            return false;
+                          });
+      std::sort(expected.begin(), expected.end());
+      std::sort(result.begin(), result.end());
+      ASSERT_EQ(result, expected);
+    }
+  }
+
+  // bulk loaded and deserialized trees are packed in Hilbert order
+  auto check_inserts = [&](rtree_type& tree)
+  {
+    check(tree);
+    for (int i = 0; i < 1000; ++i)
+    {
+      tree.insert({ point_type(dist(mt), dist(mt)), next++ });
+    }
+    check(tree);
+    ASSERT_EQ(tree.size(), rstar.size() + 1000);
+  };
+  rtree_type bulk;
+  bulk.bulk_load<er::PRTreeBulkLoad>(rstar.begin(), rstar.end());
+  check_inserts(bulk);
+
+  std::stringstream stream;
+  ASSERT_TRUE(rstar.save(stream));
+  rtree_type loaded;
+  ASSERT_TRUE(loaded.load(stream));
+  check_inserts(loaded);
+
+  // erase everything
+  while (!rtree.empty())
+  {
+    rtree.erase(rtree.begin());
+  }
+  ASSERT_EQ(rtree.leaf_level(), 0);
+}